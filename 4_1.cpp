@@ -1,11 +1,22 @@
 #include <GL/glut.h>
+#include <chrono>
 #include <cmath>
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <future>
+#include "bezier_core.h"
+#include "bezier_batch.h"
+#include "bezier_adaptive.h"
+#include "bezier_gpu.h"
+#include "bezier_raytrace.h"
+#include "frame_scheduler.h"
+#include "headless.h"
+#include "mesh_worker.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -13,30 +24,6 @@
 
 using namespace std;
 
-struct Vec3 {
-    float x, y, z;
-    Vec3() :x(0), y(0), z(0) {}
-    Vec3(float X, float Y, float Z) :x(X), y(Y), z(Z) {}
-    Vec3 operator+(const Vec3& o) const { return Vec3(x + o.x, y + o.y, z + o.z); }
-    Vec3 operator-(const Vec3& o) const { return Vec3(x - o.x, y - o.y, z - o.z); }
-    Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
-};
-
-static inline Vec3 crossp(const Vec3& a, const Vec3& b) {
-    return Vec3(a.y * b.z - a.z * b.y,
-        a.z * b.x - a.x * b.z,
-        a.x * b.y - a.y * b.x);
-}
-static inline float dotp(const Vec3& a, const Vec3& b) {
-    return a.x * b.x + a.y * b.y + a.z * b.z;
-}
-static inline float len(const Vec3& v) { return sqrtf(dotp(v, v)); }
-static inline Vec3 normalize(const Vec3& v) {
-    float L = len(v);
-    if (L == 0.0f) return Vec3(0, 0, 1);
-    return v * (1.0f / L);
-}
-
 // Control points
 Vec3 ctrl[4][4];
 
@@ -44,18 +31,68 @@ int selectedIndex = 0; // 0..15
 
 int res = 10; // initial 10x10 resolution
 
+// tessellation backend
+enum EvalMode { EVAL_DIRECT = 0, EVAL_FORWARD_DIFF = 1, EVAL_SIMD_BATCH = 2, EVAL_GPU = 3 };
+EvalMode evalMode = EVAL_DIRECT;
+BatchKernel batchKernel = batchDetectKernel();
+const float fwdDiffTolerance = 1e-3f; // max allowed drift from direct evaluation
+
 // Camera spherical coords
 float camDist = 6.0f;
 float camAzimuth = 45.0f;
 float camElevation = 20.0f;
 
-// computed mesh
-struct Tri {
-    Vec3 v0, v1, v2;
-    Vec3 normal;
-    Vec3 color;
+// view-dependent adaptive tessellation (replaces res when enabled)
+bool adaptive = false;
+float pixelTol = 1.0f;          // max projected chord error in pixels
+const int adaptiveMaxDepth = 10;
+AdaptiveMesh adaptiveMesh;
+AdaptiveView adaptiveLastView;
+bool adaptiveDirty = true;
+
+// computed mesh: shared grid vertices, 32-bit triangle indices, analytic vertex normals.
+// Buffers are resized in place so rebuilds reuse their storage.
+struct GridMesh {
+    vector<Vec3> verts;       // (res+1)*(res+1), index = v*(res+1)+u
+    vector<Vec3> normals;     // 1 per vertex, normalize(Pu x Pv)
+    vector<uint32_t> indices; // 3 per triangle
+    vector<Vec3> du, dv;      // Pu/Pv per vertex when derivsValid
+    int res = -1;             // grid resolution, -1 when there is no grid (adaptive, gpu)
+    int indexRes = -1;        // res the index buffer was built for
+    EvalMode mode = EVAL_DIRECT;
+    bool derivsValid = false;
+    int incrementalUpdates = 0;
+};
+GridMesh adaptiveGrid;        // adaptive output, built on the render thread against its camera
+vector<Vec3> meshColors;      // per-frame shaded vertex colors
+
+// The grid is tessellated on a worker thread (see mesh_worker.h). Input handlers post
+// edits; the worker keeps its own copy of the net and settings, folds together the
+// edits that queued up during the previous build, and glutDisplay() swaps the result in.
+enum MeshEditKind { EDIT_MOVE, EDIT_SETTINGS };
+struct MeshEdit {
+    MeshEditKind kind;
+    int i, j;                 // EDIT_MOVE: ctrl[i][j] += delta
+    Vec3 delta;
+    int res;                  // EDIT_SETTINGS: tessellate at res with mode, or not at all when off
+    EvalMode mode;
+    bool off;
 };
-vector<Tri> triangles;
+
+// worker-side state, touched only by the mesh builder
+Vec3 workCtrl[4][4];
+BatchGrid meshBatch;          // SIMD batch scratch (SoA)
+int workRes = -1;
+EvalMode workMode = EVAL_DIRECT;
+bool workOff = false;
+
+// incremental control-point edits: P += delta * Bu[i] * Bv[j] on the cached grid
+vector<float> gridB, gridDB;  // Bernstein values/derivatives at the res+1 grid parameters
+int gridBasisRes = -1;
+const int incrementalRebuildEvery = 256; // full rebuild to flush accumulated float drift
+
+MeshWorker<MeshEdit, GridMesh> meshWorker;
+bool meshPollArmed = false;   // a timer is waiting for the worker to finish
 
 // material and light
 Vec3 lightColor = Vec3(1.0f, 1.0f, 1.0f);
@@ -64,6 +101,56 @@ Vec3 kd = Vec3(0.7f, 0.5f, 0.2f);
 
 Vec3 patchCenter(0, 0, 0);
 
+// EVAL_GPU: the vertex shader evaluates the patch on a static (u,v) grid and
+// applies the same per-vertex lighting as glutDisplay()
+GpuPatch gpuPatch;
+GLint gpuLightPosLoc = -1, gpuKdLoc = -1, gpuLightColorLoc = -1;
+
+static const char* gpuShadeVS =
+    "uniform vec3 lightPos;\n"
+    "uniform vec3 kd;\n"
+    "uniform vec3 lightColor;\n"
+    "vec4 shade(vec3 P, vec3 N) {\n"
+    "    float ndotl = max(dot(N, normalize(lightPos - P)), 0.0);\n"
+    "    return vec4(min(kd * lightColor * ndotl + vec3(0.08), vec3(1.0)), 1.0);\n"
+    "}\n";
+
+static const char* gpuShadeFS =
+    "#version 120\n"
+    "void main() {\n"
+    "    gl_FragColor = gl_Color;\n"
+    "}\n";
+
+// Builds the shader path on first use; false when the context cannot run it
+static bool gpuReady() {
+    if (gpuPatch.tried) return gpuPatch.program != 0;
+    if (!gpuPatchInit(gpuPatch, gpuShadeVS, gpuShadeFS)) return false;
+    gpuLightPosLoc = glExt.GetUniformLocation(gpuPatch.program, "lightPos");
+    gpuKdLoc = glExt.GetUniformLocation(gpuPatch.program, "kd");
+    gpuLightColorLoc = glExt.GetUniformLocation(gpuPatch.program, "lightColor");
+    return true;
+}
+
+// ray-traced rendering of the exact patch (replaces the mesh when on); refined over
+// several frames in a window, finished in one frame for headless shots
+bool raytrace = false;
+RtPatch rtPatch;
+RtImage rtImage;
+double rtMs = 0.0; // tracing time of the current image so far
+
+static WorkStealingPool& rtPool() {
+    static WorkStealingPool pool;
+    return pool;
+}
+
+// mouse picking: the control point nearest the cursor on screen, otherwise the
+// surface point under it, found through rtPatch's subdivision hierarchy
+const float pickRadius = 12.0f; // pixels
+GLdouble pickModelview[16], pickProjection[16]; // matrices of the last frame
+GLint pickViewport[4] = { 0, 0, 0, 0 };
+bool pickValid = false;
+float pickU = 0.0f, pickV = 0.0f;
+
 static bool loadControlPointsFromFile(const char* fname) {
     ifstream in(fname);
     if (!in.is_open()) return false;
@@ -106,72 +193,239 @@ static void computePatchCenter() {
     patchCenter = sum * (1.0f / 16.0f);
 }
 
-// Bernstein basis n=3
-static void bernstein3(float u, float B[4]) {
-    float um = 1.0f - u;
-    // B0 = (1-u)^3
-    // B1 = 3u(1-u)^2
-    // B2 = 3u^2(1-u)
-    // B3 = u^3
-    B[0] = um * um * um;
-    B[1] = 3.0f * u * um * um;
-    B[2] = 3.0f * u * u * um;
-    B[3] = u * u * u;
-}
-
-// Evaluate patch point P(u,v) iteratively
-static Vec3 evaluatePatchPt(float u, float v) {
-    float Bu[4], Bv[4];
-    bernstein3(u, Bu);
-    bernstein3(v, Bv);
-    Vec3 P(0, 0, 0);
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 4; j++) {
-            float b = Bu[i] * Bv[j];
-            P = P + ctrl[i][j] * b;
+// Evaluate patch point P(u,v) of net iteratively
+static Vec3 evaluatePatchPt(const Vec3 (&net)[4][4], float u, float v) {
+    return bezierEval(net, u, v);
+}
+
+// Power-basis coefficients C[a][b] of P(u,v) = sum C[a][b] u^a v^b.
+// Recomputed once per control-point change (C = M * ctrl * M^T).
+Vec3 powerCoeffs[4][4];
+
+static void updatePowerCoeffs() {
+    bezierToPower(ctrl, powerCoeffs);
+}
+
+static void evalPatch(float u, float v, PatchEval& e, bool second = false) {
+    bezierEvalPower(powerCoeffs, u, v, e, second);
+}
+
+// Max distance between the forward-differenced grid of net and direct evaluation
+static float forwardDiffMaxError(const Vec3 (&net)[4][4], int steps) {
+    vector<Vec3> grid(static_cast<size_t>(steps + 1) * (steps + 1));
+    forwardDiffGrid(net, steps, grid.data());
+    float maxErr = 0.0f;
+    for (int v = 0; v <= steps; v++) {
+        float fv = static_cast<float>(v) / static_cast<float>(steps);
+        for (int u = 0; u <= steps; u++) {
+            float fu = static_cast<float>(u) / static_cast<float>(steps);
+            Vec3 d = grid[static_cast<size_t>(v) * (steps + 1) + u] - evaluatePatchPt(net, fu, fv);
+            maxErr = fmaxf(maxErr, len(d));
         }
     }
-    return P;
+    return maxErr;
 }
 
-// Build mesh (triangles) 
-static void buildMesh() {
-    triangles.clear();
-    int N = res;
+static void reportForwardDiffError(const Vec3 (&net)[4][4], int steps) {
+    float err = forwardDiffMaxError(net, steps);
+    printf("Forward differencing at res %d: max deviation %.3g (%s tolerance %.0e)\n",
+        steps, err, err <= fwdDiffTolerance ? "within" : "EXCEEDS", fwdDiffTolerance);
+}
 
-    vector<vector<Vec3>> grid(N + 1, vector<Vec3>(N + 1));
-    for (int v = 0; v <= N; v++) {
-        float fv = static_cast<float>(v) / static_cast<float>(N);
-        for (int u = 0; u <= N; u++) {
-            float fu = static_cast<float>(u) / static_cast<float>(N);
-            grid[u][v] = evaluatePatchPt(fu, fv);
-        }
+// The drift sweep up to res 4096 builds grids of hundreds of MB, so it runs on its own
+// thread over a copy of the net; input and redraws carry on meanwhile
+static future<void> driftJob;
+
+static void startDriftCheck() {
+    if (driftJob.valid() && driftJob.wait_for(chrono::seconds(0)) != future_status::ready) {
+        printf("Forward-difference drift check still running\n");
+        return;
     }
+    Vec3 net[4][4];
+    memcpy(net, ctrl, sizeof(net));
+    driftJob = async(launch::async, [net] {
+        for (int n = 256; n <= 4096; n *= 4) reportForwardDiffError(net, n);
+        fflush(stdout);
+    });
+}
 
-    // create triangles: each cell two triangles
+static void buildIndices(GridMesh& m, int N) {
+    m.indices.clear();
+    m.indices.reserve(static_cast<size_t>(N) * N * 6);
+    uint32_t stride = static_cast<uint32_t>(N + 1);
     for (int v = 0; v < N; v++) {
         for (int u = 0; u < N; u++) {
-            Vec3 p00 = grid[u][v];
-            Vec3 p10 = grid[u + 1][v];
-            Vec3 p01 = grid[u][v + 1];
-            Vec3 p11 = grid[u + 1][v + 1];
+            uint32_t i00 = v * stride + u;
+            uint32_t i10 = i00 + 1;
+            uint32_t i01 = i00 + stride;
+            uint32_t i11 = i01 + 1;
             // triangle 1
-            Tri t1;
-            t1.v0 = p00; t1.v1 = p10; t1.v2 = p11;
-            Vec3 e1 = t1.v1 - t1.v0;
-            Vec3 e2 = t1.v2 - t1.v0;
-            t1.normal = normalize(crossp(e1, e2));
+            m.indices.push_back(i00); m.indices.push_back(i10); m.indices.push_back(i11);
             // triangle 2
-            Tri t2;
-            t2.v0 = p00; t2.v1 = p11; t2.v2 = p01;
-            e1 = t2.v1 - t2.v0;
-            e2 = t2.v2 - t2.v0;
-            t2.normal = normalize(crossp(e1, e2));
-            triangles.push_back(t1);
-            triangles.push_back(t2);
+            m.indices.push_back(i00); m.indices.push_back(i11); m.indices.push_back(i01);
+        }
+    }
+    m.indexRes = N;
+}
+
+static const char* evalModeName() {
+    static char batchName[32];
+    if (evalMode == EVAL_FORWARD_DIFF) return "fwd-diff";
+    if (evalMode == EVAL_GPU) return "gpu";
+    if (evalMode == EVAL_SIMD_BATCH) {
+        snprintf(batchName, sizeof(batchName), "batch-%s", batchKernelName(batchKernel));
+        return batchName;
+    }
+    return "direct";
+}
+
+// Build mesh (triangles) of net at resolution N into m
+static void buildMesh(GridMesh& m, const Vec3 (&net)[4][4], int N, EvalMode mode) {
+    m.incrementalUpdates = 0;
+    m.mode = mode;
+    m.res = N;
+
+    size_t count = static_cast<size_t>(N + 1) * (N + 1);
+    m.verts.resize(count);
+    m.normals.resize(count);
+    if (mode == EVAL_FORWARD_DIFF) {
+        Vec3 du[4][4], dv[4][4];
+        derivativeNets(net, du, dv);
+        m.du.resize(count);
+        m.dv.resize(count);
+        forwardDiffGrid(net, N, m.verts.data());
+        forwardDiffGrid(du, N, m.du.data());
+        forwardDiffGrid(dv, N, m.dv.data());
+        for (size_t k = 0; k < count; k++) m.normals[k] = normalize(crossp(m.du[k], m.dv[k]));
+    }
+    else if (mode == EVAL_SIMD_BATCH) {
+        // normals only; edits in this mode fall back to a full (vectorized) rebuild
+        Vec3 C[4][4];
+        BatchCoeffs c;
+        bezierToPower(net, C);
+        batchLoadCoeffs(c, &C[0][0].x);
+        meshBatch.resize(count, N + 1);
+        batchEvalGrid(batchKernel, c, N + 1, N + 1, meshBatch.out(), meshBatch.us.data());
+        batchGridToAoS(meshBatch, count, &m.verts[0].x, &m.normals[0].x);
+    }
+    else {
+        Vec3 C[4][4];
+        bezierToPower(net, C);
+        m.du.resize(count);
+        m.dv.resize(count);
+        PatchEval e;
+        for (int v = 0; v <= N; v++) {
+            float fv = static_cast<float>(v) / static_cast<float>(N);
+            for (int u = 0; u <= N; u++) {
+                float fu = static_cast<float>(u) / static_cast<float>(N);
+                bezierEvalPower(C, fu, fv, e);
+                int k = v * (N + 1) + u;
+                m.verts[k] = e.P;
+                m.du[k] = e.Pu;
+                m.dv[k] = e.Pv;
+                m.normals[k] = normalize(crossp(e.Pu, e.Pv));
+            }
+        }
+    }
+    m.derivsValid = (mode != EVAL_SIMD_BATCH);
+
+    if (m.indexRes != N) buildIndices(m, N);
+}
+
+static void ensureGridBasis(int N) {
+    if (gridBasisRes == N) return;
+    gridB.resize(static_cast<size_t>(N + 1) * 4);
+    gridDB.resize(static_cast<size_t>(N + 1) * 4);
+    for (int k = 0; k <= N; k++) {
+        float t = static_cast<float>(k) / static_cast<float>(N);
+        bernstein<3>(t, &gridB[k * 4]);
+        bernsteinDeriv<3>(t, &gridDB[k * 4]);
+    }
+    gridBasisRes = N;
+}
+
+// Rank-1 update of the grid in m after ctrl[ci][cj] moved by delta (m.derivsValid)
+static void updateMeshIncremental(GridMesh& m, int ci, int cj, const Vec3& delta) {
+    int N = m.res;
+    ensureGridBasis(N);
+    for (int v = 0; v <= N; v++) {
+        float bv = gridB[v * 4 + cj], dbv = gridDB[v * 4 + cj];
+        if (bv == 0.0f && dbv == 0.0f) continue;
+        for (int u = 0; u <= N; u++) {
+            float bu = gridB[u * 4 + ci], dbu = gridDB[u * 4 + ci];
+            float w = bu * bv, wu = dbu * bv, wv = bu * dbv;
+            if (w == 0.0f && wu == 0.0f && wv == 0.0f) continue; // vertex unaffected
+            int k = v * (N + 1) + u;
+            m.verts[k] = m.verts[k] + delta * w;
+            m.du[k] = m.du[k] + delta * wu;
+            m.dv[k] = m.dv[k] + delta * wv;
+            m.normals[k] = normalize(crossp(m.du[k], m.dv[k]));
+        }
+    }
+}
+
+// Worker: fold the queued edits into workCtrl and the settings, then fill back.
+// Moves alone update a copy of the published grid incrementally; anything else
+// (or too many incremental updates in a row) is one full rebuild.
+static void applyMeshEdits(const vector<MeshEdit>& edits, GridMesh& back, const GridMesh& published) {
+    Vec3 moved[4][4];
+    bool full = false;
+    for (const MeshEdit& e : edits) {
+        if (e.kind == EDIT_MOVE) {
+            workCtrl[e.i][e.j] = workCtrl[e.i][e.j] + e.delta;
+            moved[e.i][e.j] = moved[e.i][e.j] + e.delta;
         }
+        else {
+            workRes = e.res;
+            workMode = e.mode;
+            workOff = e.off;
+            full = true;
+        }
+    }
+    if (workOff) {
+        back.res = back.indexRes = -1;
+        back.derivsValid = false;
+        back.verts.clear();
+        back.normals.clear();
+        back.indices.clear();
+        return;
+    }
+    if (!full && published.derivsValid && published.res == workRes && published.mode == workMode &&
+        published.incrementalUpdates + 1 < incrementalRebuildEvery) {
+        back = published; // vectors keep their capacity
+        back.incrementalUpdates++;
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++) {
+                const Vec3& d = moved[i][j];
+                if (d.x != 0.0f || d.y != 0.0f || d.z != 0.0f) updateMeshIncremental(back, i, j, d);
+            }
+        return;
     }
+    buildMesh(back, workCtrl, workRes, workMode);
+}
 
+// Re-tessellate adaptively when the camera or the control points changed.
+// Reads the matrices set up by gluPerspective/gluLookAt for this frame.
+static void updateAdaptiveMesh() {
+    GLdouble proj[16], mv[16];
+    glGetDoublev(GL_PROJECTION_MATRIX, proj);
+    glGetDoublev(GL_MODELVIEW_MATRIX, mv);
+    AdaptiveView view;
+    adaptiveSetView(view, proj, mv, headlessWindowWidth(), headlessWindowHeight());
+    if (!adaptiveDirty && memcmp(&view, &adaptiveLastView, sizeof(view)) == 0) return;
+    adaptiveLastView = view;
+    adaptiveDirty = false;
+
+    BezierNet net;
+    memcpy(net.p, ctrl, sizeof(net.p));
+    tessellateAdaptive(net, view, pixelTol, adaptiveMaxDepth, adaptiveMesh);
+
+    size_t count = adaptiveMesh.pos.size() / 3;
+    adaptiveGrid.verts.resize(count);
+    adaptiveGrid.normals.resize(count);
+    memcpy(&adaptiveGrid.verts[0].x, adaptiveMesh.pos.data(), count * sizeof(Vec3));
+    memcpy(&adaptiveGrid.normals[0].x, adaptiveMesh.nrm.data(), count * sizeof(Vec3));
+    adaptiveGrid.indices = adaptiveMesh.idx;
 }
 
 static void indexToCtrlCoord(int idx, int& cx, int& cy) {
@@ -179,18 +433,211 @@ static void indexToCtrlCoord(int idx, int& cx, int& cy) {
     cy = idx / 4; cx = idx % 4;
 }
 
+static void meshPollTimer(int);
+
+// Asks for a frame once the worker has a mesh ready (GLUT calls stay on this thread)
+static void watchMeshWorker() {
+    if (meshPollArmed || !meshWorker.threaded()) return;
+    meshPollArmed = true;
+    glutTimerFunc(4, meshPollTimer, 0);
+}
+
+static void meshPollTimer(int) {
+    meshPollArmed = false;
+    if (meshWorker.ready()) schedRequest(DIRTY_MESH | DIRTY_HUD);
+    else if (meshWorker.busy()) watchMeshWorker();
+}
+
+static void postMeshEdit(const MeshEdit& e) {
+    meshWorker.post(e);
+    watchMeshWorker();
+    schedRequest(DIRTY_MESH | DIRTY_HUD);
+}
+
 // keyboard and interaction
+static void moveControlPoint(int cx, int cy, const Vec3& delta) {
+    ctrl[cx][cy] = ctrl[cx][cy] + delta;
+    patchCenter = patchCenter + delta * (1.0f / 16.0f);
+    adaptiveDirty = true;
+    MeshEdit e = {};
+    e.kind = EDIT_MOVE;
+    e.i = cx;
+    e.j = cy;
+    e.delta = delta;
+    postMeshEdit(e);
+}
+
 static void adjustSelectedControlPoint(float dx, float dy, float dz) {
     int cx, cy;
     indexToCtrlCoord(selectedIndex, cx, cy);
-    ctrl[cx][cy].x += dx;
-    ctrl[cx][cy].y += dy;
-    ctrl[cx][cy].z += dz;
+    moveControlPoint(cx, cy, Vec3(dx, dy, dz));
+}
+
+// Full re-tessellation with the current res/evalMode (none for adaptive and gpu)
+static MeshEdit settingsEdit() {
+    MeshEdit e = {};
+    e.kind = EDIT_SETTINGS;
+    e.res = res;
+    e.mode = evalMode;
+    e.off = adaptive || evalMode == EVAL_GPU;
+    return e;
+}
+
+static void requestMeshRebuild() {
     computePatchCenter();
-    buildMesh();
+    adaptiveDirty = true;
+    postMeshEdit(settingsEdit());
+}
+
+// GLUT window coordinates (origin top left) to a world-space ray through the pixel centre
+static bool pickRay(int x, int y, Vec3& O, Vec3& D) {
+    if (pickViewport[2] == 0) return false; // no frame drawn yet
+    double wx = x + 0.5, wy = pickViewport[3] - y - 0.5;
+    double n[3], f[3];
+    if (!gluUnProject(wx, wy, 0.0, pickModelview, pickProjection, pickViewport, &n[0], &n[1], &n[2])) return false;
+    if (!gluUnProject(wx, wy, 1.0, pickModelview, pickProjection, pickViewport, &f[0], &f[1], &f[2])) return false;
+    O = Vec3(static_cast<float>(n[0]), static_cast<float>(n[1]), static_cast<float>(n[2]));
+    D = normalize(Vec3(static_cast<float>(f[0]), static_cast<float>(f[1]), static_cast<float>(f[2])) - O);
+    return true;
+}
+
+// Control point (keyboard numbering) nearest to (x, y) on screen within pickRadius, -1 if none
+static int pickControlPoint(int x, int y) {
+    int best = -1;
+    double bestD2 = pickRadius * pickRadius;
+    double wx = x + 0.5, wy = pickViewport[3] - y - 0.5;
+    for (int idx = 0; idx < 16; idx++) {
+        int cx, cy;
+        indexToCtrlCoord(idx, cx, cy);
+        const Vec3& p = ctrl[cx][cy];
+        double sx, sy, sz;
+        if (!gluProject(p.x, p.y, p.z, pickModelview, pickProjection, pickViewport, &sx, &sy, &sz)) continue;
+        if (sz < 0.0 || sz > 1.0) continue; // clipped by the near or far plane
+        double d2 = (sx - wx) * (sx - wx) + (sy - wy) * (sy - wy);
+        if (d2 < bestD2) {
+            bestD2 = d2;
+            best = idx;
+        }
+    }
+    return best;
+}
+
+// Selects a control point or reports the (u, v), position and normal under (x, y)
+static bool pickAt(int x, int y) {
+    Vec3 O, D;
+    if (!pickRay(x, y, O, D)) return false;
+    int idx = pickControlPoint(x, y);
+    if (idx >= 0) {
+        selectedIndex = idx;
+        printf("Selected control point %d\n", idx);
+        return true;
+    }
+    if (!rtSameNet(rtPatch, ctrl)) rtBuild(rtPatch, ctrl);
+    auto t0 = chrono::steady_clock::now();
+    RtHit hit;
+    pickValid = rtPick(rtPatch, O, D, hit);
+    double us = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+    if (!pickValid) {
+        printf("No surface under (%d, %d)\n", x, y);
+        return true;
+    }
+    pickU = hit.u;
+    pickV = hit.v;
+    printf("Surface at (u, v) = (%.4f, %.4f)  P = (%.3f, %.3f, %.3f)  N = (%.3f, %.3f, %.3f)  in %.1f us\n",
+        hit.u, hit.v, hit.P.x, hit.P.y, hit.P.z, hit.N.x, hit.N.y, hit.N.z, us);
+    return true;
+}
+
+// Traces the next pass (all remaining passes when headless) and draws the image with
+// its depth, so the axes and control net drawn afterwards are hidden by the surface
+static void drawRaytraced(const Vec3& camPos, const Vec3& lightPos) {
+    int w = headlessWindowWidth(), h = headlessWindowHeight();
+    RtCamera cam = rtLookAt(camPos, patchCenter, Vec3(0, 1, 0), 45.0f, static_cast<float>(w) / static_cast<float>(h), 0.1f, 100.0f);
+    bool rebuilt = !rtSameNet(rtPatch, ctrl);
+    if (rebuilt) rtBuild(rtPatch, ctrl);
+    if (rtRestartIfChanged(rtImage, w, h, cam) || rebuilt) {
+        rtImage.step = 0;
+        rtMs = 0.0;
+    }
+
+    // same per-vertex lighting as the mesh path in glutDisplay(), per pixel
+    static const unsigned char background[3] = { 31, 31, 31 };
+    auto shade = [&](const Vec3& P, const Vec3& N, unsigned char* rgb) {
+        float ndotl = max(dotp(N, normalize(lightPos - P)), 0.0f);
+        float col[3] = { kd.x * lightColor.x * ndotl + 0.08f, kd.y * lightColor.y * ndotl + 0.08f, kd.z * lightColor.z * ndotl + 0.08f };
+        for (int k = 0; k < 3; k++) rgb[k] = static_cast<unsigned char>(fminf(1.0f, col[k]) * 255.0f + 0.5f);
+    };
+    do {
+        int step = rtNextStep(rtImage);
+        if (step == 0) break;
+        auto t0 = chrono::steady_clock::now();
+        rtRenderPass(rtPatch, rtImage, step, background, rtPool(), shade);
+        rtMs += chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        if (step == 1)
+            printf("Ray traced %dx%d in %.1f ms on %u threads (%d leaves)\n", w, h, rtMs, rtPool().size(), rtPatch.leaves);
+    } while (headless.active);
+    if (rtNextStep(rtImage) != 0) schedRequest(DIRTY_HUD); // refine on the next frame
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glRasterPos2f(-1.0f, -1.0f);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glDepthFunc(GL_ALWAYS);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDrawPixels(w, h, GL_DEPTH_COMPONENT, GL_FLOAT, rtImage.depth.data());
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthFunc(GL_LESS);
+    glDisable(GL_DEPTH_TEST);
+    glDrawPixels(w, h, GL_RGB, GL_UNSIGNED_BYTE, rtImage.rgb.data());
+    glEnable(GL_DEPTH_TEST);
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// HUD text
+static void drawHud() {
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    int windowWidth = glutGet(GLUT_WINDOW_WIDTH);
+    int windowHeight = glutGet(GLUT_WINDOW_HEIGHT);
+    glOrtho(0, windowWidth, 0, windowHeight, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glColor3f(1, 1, 1);
+    char buf[256];
+    if (raytrace)
+        sprintf_s(buf, sizeof(buf), "raytrace (t): step %d  %.1f ms  %u threads  leaves = %d   selected = %d (0-9,a-f)  move: j/l i/k u/o  quit: q/esc",
+            rtImage.step, rtMs, rtPool().size(), rtPatch.leaves, selectedIndex);
+    else if (adaptive)
+        sprintf_s(buf, sizeof(buf), "adaptive (v): tol = %.2f px (+/-)  leaves = %d  tris = %d  depth = %d   selected = %d (0-9,a-f)  move: j/l i/k u/o  quit: q/esc",
+            pixelTol, adaptiveMesh.leaves, static_cast<int>(adaptiveGrid.indices.size() / 3), adaptiveMesh.deepest, selectedIndex);
+    else
+        sprintf_s(buf, sizeof(buf), "res = %d  (use +/-)  eval: %s (g)%s   selected = %d (0-9,a-f)  move: j/l i/k u/o  reset: r  quit: q/esc",
+            res, evalModeName(), meshWorker.busy() ? "  tessellating..." : "", selectedIndex);
+    glRasterPos2i(10, windowHeight - 20);
+    for (char* c = buf; *c; c++) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
 }
 
 static void glutDisplay() {
+    schedBeginFrame();
+    // take the newest finished mesh; without a worker thread build it here, so headless shots show every edit
+    meshWorker.runInline();
+    meshWorker.swap();
+    if (meshWorker.busy()) watchMeshWorker();
+
     glClearColor(0.12f, 0.12f, 0.12f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glEnable(GL_DEPTH_TEST);
@@ -198,7 +645,7 @@ static void glutDisplay() {
     // Setup projection and camera
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    float aspect = static_cast<float>(glutGet(GLUT_WINDOW_WIDTH)) / static_cast<float>(glutGet(GLUT_WINDOW_HEIGHT));
+    float aspect = static_cast<float>(headlessWindowWidth()) / static_cast<float>(headlessWindowHeight());
     gluPerspective(45.0, aspect, 0.1, 100.0);
 
     glMatrixMode(GL_MODELVIEW);
@@ -216,9 +663,18 @@ static void glutDisplay() {
         patchCenter.x, patchCenter.y, patchCenter.z,
         0.0, 1.0, 0.0);
 
+    // picking unprojects with this frame's matrices
+    glGetDoublev(GL_MODELVIEW_MATRIX, pickModelview);
+    glGetDoublev(GL_PROJECTION_MATRIX, pickProjection);
+    glGetIntegerv(GL_VIEWPORT, pickViewport);
+
+    if (adaptive) updateAdaptiveMesh();
+
     // set light at camera position 
     Vec3 lightPos = camPos;
 
+    if (raytrace) drawRaytraced(camPos, lightPos);
+
     glPushMatrix();
     glTranslatef(patchCenter.x, patchCenter.y, patchCenter.z);
     glLineWidth(2.0f);
@@ -232,32 +688,46 @@ static void glutDisplay() {
     glEnd();
     glPopMatrix();
 
-    // draw patch triangles with per-triangle color
-    glShadeModel(GL_FLAT);
-    glBegin(GL_TRIANGLES);
-    for (size_t i = 0; i < triangles.size(); i++) {
-        Tri& t = triangles[i];
-        // triangle center
-        Vec3 center = (t.v0 + t.v1 + t.v2) * (1.0f / 3.0f);
-        Vec3 L = normalize(lightPos - center);
-        float ndotl = dotp(t.normal, L);
-        if (ndotl < 0) ndotl = 0;
-        Vec3 col = Vec3(kd.x * lightColor.x * ndotl,
-            kd.y * lightColor.y * ndotl,
-            kd.z * lightColor.z * ndotl);
-
+    if (!raytrace && evalMode == EVAL_GPU && !adaptive) {
+        gpuPatchSetGrid(gpuPatch, res + 1);
+        gpuPatchBind(gpuPatch, &ctrl[0][0].x);
+        glExt.Uniform3f(gpuLightPosLoc, lightPos.x, lightPos.y, lightPos.z);
+        glExt.Uniform3f(gpuKdLoc, kd.x, kd.y, kd.z);
+        glExt.Uniform3f(gpuLightColorLoc, lightColor.x, lightColor.y, lightColor.z);
+        gpuPatchDraw(gpuPatch);
+    }
+    else if (!raytrace) {
+        // shade each shared vertex once with its analytic normal, then draw indexed
+        // the front mesh may lag the control points by a build while the worker catches up
+        const GridMesh& m = adaptive ? adaptiveGrid : meshWorker.front();
+        const vector<Vec3>& meshVerts = m.verts;
+        const vector<Vec3>& meshNormals = m.normals;
+        meshColors.resize(meshVerts.size());
         Vec3 ambient = Vec3(0.08f, 0.08f, 0.08f);
-        col = col + ambient;
-        // clamp
-        col.x = fminf(1.0f, col.x); col.y = fminf(1.0f, col.y); col.z = fminf(1.0f, col.z);
-        glColor3f(col.x, col.y, col.z);
-        // supply normal for correctness 
-        glNormal3f(t.normal.x, t.normal.y, t.normal.z);
-        glVertex3f(t.v0.x, t.v0.y, t.v0.z);
-        glVertex3f(t.v1.x, t.v1.y, t.v1.z);
-        glVertex3f(t.v2.x, t.v2.y, t.v2.z);
+        for (size_t i = 0; i < meshVerts.size(); i++) {
+            Vec3 L = normalize(lightPos - meshVerts[i]);
+            float ndotl = dotp(meshNormals[i], L);
+            if (ndotl < 0) ndotl = 0;
+            Vec3 col = Vec3(kd.x * lightColor.x * ndotl,
+                kd.y * lightColor.y * ndotl,
+                kd.z * lightColor.z * ndotl);
+            col = col + ambient;
+            // clamp
+            col.x = fminf(1.0f, col.x); col.y = fminf(1.0f, col.y); col.z = fminf(1.0f, col.z);
+            meshColors[i] = col;
+        }
+        glShadeModel(GL_SMOOTH);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(Vec3), meshVerts.data());
+        glNormalPointer(GL_FLOAT, sizeof(Vec3), meshNormals.data());
+        glColorPointer(3, GL_FLOAT, sizeof(Vec3), meshColors.data());
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(m.indices.size()), GL_UNSIGNED_INT, m.indices.data());
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
     }
-    glEnd();
 
     // draw control points (GL_POINTS)
     glPointSize(8.0f);
@@ -295,31 +765,27 @@ static void glutDisplay() {
         glEnd();
     }
 
-    // HUD text
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    int windowWidth = glutGet(GLUT_WINDOW_WIDTH);
-    int windowHeight = glutGet(GLUT_WINDOW_HEIGHT);
-    glOrtho(0, windowWidth, 0, windowHeight, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-    glColor3f(1, 1, 1);
-    char buf[256];
-    sprintf_s(buf, sizeof(buf), "res = %d  (use +/-)   selected = %d (0-9,a-f)  move: j/l i/k u/o  reset: r  quit: q/esc", res, selectedIndex);
-    glRasterPos2i(10, windowHeight - 20);
-    for (char* c = buf; *c; c++) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
-    glPopMatrix();
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-
-    glutSwapBuffers();
-}
+    // picked surface point and its normal; follows the surface through edits
+    if (pickValid) {
+        PatchEval e;
+        updatePowerCoeffs();
+        evalPatch(pickU, pickV, e);
+        Vec3 tip = e.P + normalize(crossp(e.Pu, e.Pv)) * 0.3f;
+        glColor3f(1.0f, 0.2f, 1.0f);
+        glPointSize(10.0f);
+        glBegin(GL_POINTS);
+        glVertex3f(e.P.x, e.P.y, e.P.z);
+        glEnd();
+        glBegin(GL_LINES);
+        glVertex3f(e.P.x, e.P.y, e.P.z);
+        glVertex3f(tip.x, tip.y, tip.z);
+        glEnd();
+    }
 
-static void glutIdle() {
-    glutPostRedisplay();
+    if (!headless.active) {
+        drawHud();
+        glutSwapBuffers();
+    }
 }
 
 static void specialKeys(int key, int x, int y) {
@@ -330,19 +796,44 @@ static void specialKeys(int key, int x, int y) {
     case GLUT_KEY_RIGHT: camAzimuth += turnStep; break;
     case GLUT_KEY_UP: camElevation += turnStep; if (camElevation > 89) camElevation = 89; break;
     case GLUT_KEY_DOWN: camElevation -= turnStep; if (camElevation < -89) camElevation = -89; break;
+    default: return;
     }
-    glutPostRedisplay();
+    schedRequest(DIRTY_CAMERA);
+}
+
+static void mouse(int button, int state, int x, int y) {
+    if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN) return;
+    if (pickAt(x, y)) schedRequest(DIRTY_HUD);
 }
 
 static void keyboard(unsigned char key, int x, int y) {
+    unsigned dirty = DIRTY_HUD;
     switch (key) {
     case 27: case 'q': exit(0); break;
     case 'r': // reset view
         camDist = 6.0f; camAzimuth = 45.0f; camElevation = 20.0f;
-        computePatchCenter(); buildMesh();
+        dirty |= DIRTY_CAMERA;
+        requestMeshRebuild();
+        break;
+    case '+':
+        if (adaptive) pixelTol = max(0.125f, pixelTol * 0.5f);
+        else res = min(100, res + 1);
+        requestMeshRebuild();
+        break;
+    case '-':
+        if (adaptive) pixelTol = min(64.0f, pixelTol * 2.0f);
+        else res = max(1, res - 1);
+        requestMeshRebuild();
+        break;
+    case 't': // ray-traced exact surface
+        raytrace = !raytrace;
+        printf("Ray tracing %s\n", raytrace ? "ON" : "OFF");
+        break;
+    case 'v': // adaptive, view-dependent tessellation
+        adaptive = !adaptive;
+        printf("Adaptive tessellation %s\n", adaptive ? "ON" : "OFF");
+        requestMeshRebuild();
         break;
-    case '+': res = min(100, res + 1); buildMesh(); break;
-    case '-': res = max(1, res - 1); buildMesh(); break;
         // select control points: '0'..'9' then 'a'..'f'
     case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
         selectedIndex = key - '0'; break;
@@ -358,9 +849,21 @@ static void keyboard(unsigned char key, int x, int y) {
     case 'k': adjustSelectedControlPoint(0, -0.05f, 0); break;
     case 'u': adjustSelectedControlPoint(0, 0, +0.05f); break;
     case 'o': adjustSelectedControlPoint(0, 0, -0.05f); break;
+        // tessellation backend: direct / forward differencing / SIMD batch / vertex shader
+    case 'g':
+        evalMode = static_cast<EvalMode>((evalMode + 1) % 4);
+        if (evalMode == EVAL_GPU && !gpuReady()) evalMode = EVAL_DIRECT;
+        printf("Evaluation: %s\n", evalModeName());
+        if (evalMode == EVAL_FORWARD_DIFF) reportForwardDiffError(ctrl, res);
+        requestMeshRebuild();
+        break;
+    case 'x': // forward-difference drift at high resolutions, off the input thread
+        startDriftCheck();
+        dirty = 0;
+        break;
         // camera zoom in/out
-    case 'w': camDist = max(1.2f, camDist - 0.4f); break;
-    case 's': camDist = min(50.0f, camDist + 0.4f); break;
+    case 'w': camDist = max(1.2f, camDist - 0.4f); dirty |= DIRTY_CAMERA; break;
+    case 's': camDist = min(50.0f, camDist + 0.4f); dirty |= DIRTY_CAMERA; break;
         // helpful debug: print control point coords
     case 'p': {
         printf("Control points:\n");
@@ -370,10 +873,71 @@ static void keyboard(unsigned char key, int x, int y) {
                 printf("%2d: (%.3f, %.3f, %.3f)\n", idx, ctrl[x][y].x, ctrl[x][y].y, ctrl[x][y].z);
             }
         }
+        dirty = 0;
         break;
     }
     }
-    glutPostRedisplay();
+    if (dirty) schedRequest(dirty);
+}
+
+// Script settings for --headless runs (see headless.h):
+//   camera AZ EL DIST   res N   eval direct|fwd-diff|batch|gpu   adaptive on|off   tol PX
+//   raytrace on|off     pick X Y (as a left click at window pixel X Y, after a shot)
+//   select I            point I X Y Z (control point I, numbered as on the keyboard)
+static bool applyHeadlessSetting(const string& key, istringstream& args) {
+    string word;
+    if (key == "camera") {
+        if (!(args >> camAzimuth >> camElevation >> camDist)) return false;
+        schedRequest(DIRTY_CAMERA);
+        return true;
+    }
+    if (key == "res") {
+        if (!(args >> res) || res < 1) return false;
+    }
+    else if (key == "eval") {
+        static const char* names[] = { "direct", "fwd-diff", "batch", "gpu" };
+        if (!(args >> word)) return false;
+        int mode = 0;
+        while (mode < 4 && word != names[mode]) mode++;
+        if (mode == 4 || (mode == EVAL_GPU && !gpuReady())) return false;
+        evalMode = static_cast<EvalMode>(mode);
+    }
+    else if (key == "adaptive") {
+        if (!(args >> word) || (word != "on" && word != "off")) return false;
+        adaptive = word == "on";
+    }
+    else if (key == "raytrace") {
+        if (!(args >> word) || (word != "on" && word != "off")) return false;
+        raytrace = word == "on";
+        schedRequest(DIRTY_HUD);
+        return true;
+    }
+    else if (key == "pick") {
+        int x, y;
+        if (!(args >> x >> y) || !pickAt(x, y)) return false;
+        schedRequest(DIRTY_HUD);
+        return true;
+    }
+    else if (key == "tol") {
+        if (!(args >> pixelTol) || pixelTol <= 0.0f) return false;
+    }
+    else if (key == "select") {
+        if (!(args >> selectedIndex) || selectedIndex < 0 || selectedIndex > 15) return false;
+        schedRequest(DIRTY_HUD);
+        return true;
+    }
+    else if (key == "point") {
+        int idx, cx, cy;
+        Vec3 p;
+        if (!(args >> idx >> p.x >> p.y >> p.z) || idx < 0 || idx > 15) return false;
+        indexToCtrlCoord(idx, cx, cy);
+        moveControlPoint(cx, cy, p - ctrl[cx][cy]);
+        computePatchCenter();
+        return true;
+    }
+    else return false;
+    requestMeshRebuild();
+    return true;
 }
 
 int main(int argc, char** argv) {
@@ -381,30 +945,49 @@ int main(int argc, char** argv) {
     bool loaded = loadControlPointsFromFile("patchPoints.txt");
     if (!loaded) setDefaultControlPoints();
     computePatchCenter();
-    buildMesh();
-
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitWindowSize(900, 700);
-    glutCreateWindow(" Bezier Patch Task1");
+    memcpy(workCtrl, ctrl, sizeof(ctrl));
+    meshWorker.setBuild(applyMeshEdits);
+    meshWorker.post(settingsEdit());
+    meshWorker.runInline(); // the first mesh is ready before the window opens
+
+    bool offscreen = headlessFromArgs(argc, argv);
+    if (!offscreen) glutInit(&argc, argv);
+    schedInitFromArgs(argc, argv);
+    if (offscreen) {
+        if (!headlessInit(900, 700)) return 1;
+        sched.offscreen = true;
+    }
+    else {
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+        glutInitWindowSize(900, 700);
+        glutCreateWindow(" Bezier Patch Task1");
+        meshWorker.startThread();
+    }
 
     glEnable(GL_POINT_SMOOTH);
     glPointSize(8.0f);
     glEnable(GL_NORMALIZE);
+    if (offscreen) return headlessRun(applyHeadlessSetting, glutDisplay);
 
     glutDisplayFunc(glutDisplay);
-    glutIdleFunc(glutIdle);
     glutKeyboardFunc(keyboard);
+    glutMouseFunc(mouse);
     glutSpecialFunc(specialKeys);
 
     cout << "Controls:\n";
     cout << "  Select control point: keys 0-9 and a-f (a->10 ... f->15). Also '[' and ']' cycle.\n";
+    cout << "  Left click: select the control point under the cursor, or report the surface (u, v), position and normal there\n";
     cout << "  Move selected point: j/l (-x/+x), i/k (+y/-y), u/o (+z/-z)\n";
-    cout << "  Increase/decrease sampling: + / -\n";
+    cout << "  Increase/decrease sampling: + / -  (tessellated on a background thread; the previous mesh stays up meanwhile)\n";
+    cout << "  Toggle view-dependent adaptive tessellation: v (+/- then halve/double the pixel tolerance)\n";
+    cout << "  Cycle tessellation backend (direct / forward-difference / SIMD batch / vertex shader): g   Report its drift at res 256..4096: x\n";
+    cout << "  Toggle ray tracing of the exact surface, refined over a few frames: t\n";
     cout << "  Camera rotate: arrow keys  Zoom: w (in) s (out)\n";
     cout << "  Reset view: r   Quit: q or Esc\n";
     cout << "  Print control points: p\n";
+    cout << "  Frames are drawn only when something changes; --fps N caps the redraw rate.\n";
     cout << "  Default control points will be used unless patchPoints.txt is present.\n";
+    cout << "  --headless script renders the frames a script describes without a window (see headless.h) and exits.\n";
 
     glutMainLoop();
     return 0;
@@ -4,6 +4,16 @@
 #include <cstdlib>
 #include <iostream>
 #include <algorithm>
+#include <vector>
+#include <map>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include "frame_scheduler.h"
+#include "gl_ext.h"
+#include "bezier_model.h"
+#include "headless.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -20,28 +30,417 @@ float camEl = 10.0f;
 float camDist = 8.0f;
 float camCenterX = 0.0f, camCenterY = 0.0f, camCenterZ = 0.0f;
 
-bool useAA = true;
+// Anti-aliasing modes, cycled with 'a'. MSAA renders the scene into a multisampled
+// target that a blit resolves onto the window; FXAA renders it single-sampled into
+// a texture and filters that onto the window in one full-screen pass. Picking never
+// sees either: ids always come from single-sampled targets of their own.
+enum AAMode { AA_OFF = 0, AA_MSAA2 = 1, AA_MSAA4 = 2, AA_MSAA8 = 3, AA_FXAA = 4, AA_MODE_COUNT = 5 };
+AAMode aaMode = AA_OFF;
+int maxSamples = 0;
+GLuint fxaaProgram = 0;
+GLint fxaaTexelLoc = -1;
 
-// Object diffuse colors (rgb)
-float objColor[3][3] = {
-    {0.8f, 0.2f, 0.2f}, // obj 0
-    {0.2f, 0.8f, 0.2f}, // obj 1
-    {0.2f, 0.2f, 0.8f}  // obj 2
+struct AATarget {
+    GLuint fbo = 0, color = 0, depth = 0, texture = 0; // color renderbuffer for MSAA, texture for FXAA
+    int w = 0, h = 0;
+    AAMode mode = AA_OFF;
+    bool ok = false;
 };
 
-// Unique pick colors
-unsigned char pickColorBytes[3][3] = {
-    { 10,  20,  30}, // id 0
-    { 40,  50,  60}, // id 1
-    { 70,  80,  90}  // id 2
+AATarget aaTarget;
+
+// GPU time of the scene pass and of the resolve / FXAA pass, read a frame or more
+// after they were issued so the HUD never stalls the pipeline
+struct AATimer {
+    GLuint queries[2] = { 0, 0 };
+    bool pending = false, poll = false;
+};
+
+AATimer aaTimer;
+double aaSceneMs = -1.0, aaPostMs = -1.0;
+const char* aaPostName = "resolve"; // what the second query timed
+
+// ---- Scene ------------------------------------------------------------------
+
+struct Vec3 {
+    float x, y, z;
+    Vec3() : x(0), y(0), z(0) {}
+    Vec3(float X, float Y, float Z) : x(X), y(Y), z(Z) {}
+    Vec3 operator+(const Vec3& o) const { return Vec3(x + o.x, y + o.y, z + o.z); }
+    Vec3 operator-(const Vec3& o) const { return Vec3(x - o.x, y - o.y, z - o.z); }
+    Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
+};
+
+enum ShapeType { SHAPE_SPHERE = 0, SHAPE_TORUS = 1, SHAPE_TEAPOT = 2, SHAPE_COUNT = 3 };
+
+// One pickable instance: world = translate(pos) * rotX(tilt) * rotY(yaw) * scale
+struct SceneObject {
+    ShapeType shape;
+    Vec3 pos;
+    float tilt, yaw, scale;
+    float color[3]; // diffuse rgb
+    int slot;       // index within its batch
+    bool selected;
+    int lod;        // level of detail, 0 = finest
+};
+
+vector<SceneObject> sceneObjects;
+bool sceneDirty = true; // transforms, membership or levels of detail changed; batches need a rebuild
+
+// Scene sizes cycled with 'n'; the first is the original three-object layout
+const int sceneSizes[] = { 3, 1000, 10000, 30000 };
+int sceneSizeIndex = 0;
+
+// Geometry of each shape at its original size (sphere 0.9, torus 0.25/0.85, teapot 0.8),
+// generated once; indexed triangles, xyz positions and unit normals
+struct ShapeMesh {
+    vector<float> pos, nrm;
+    vector<uint32_t> idx;
+    float radius = 0.0f; // bounding sphere about the origin
+};
+
+// Every shape is built at lodLevels tessellations (48, 24, 12 and 6 segments; the
+// teapot by clustering its vertices down to the same triangle ratios). Meshes, batches and
+// buffers are indexed by shape * lodLevels + level, so each level is its own
+// instanced draw and the shading and pick passes always agree on the geometry.
+const int lodLevels = 4;
+const int batchCount = SHAPE_COUNT * lodLevels;
+const int lodSegments[lodLevels] = { 48, 24, 12, 6 };
+
+// An object drops to level L + 1 once its projected radius falls below lodCut[L]
+// pixels. It must clear a cut by lodHysteresis either way before switching, so an
+// object sitting on a cut does not flicker as the camera creeps.
+const float lodCut[lodLevels - 1] = { 48.0f, 20.0f, 8.0f };
+const float lodHysteresis = 0.15f;
+bool useLod = true;
+int lodCounts[lodLevels] = { 0, 0, 0, 0 };
+double lodTriangles = 0.0; // per frame, all objects
+
+ShapeMesh shapeMeshes[batchCount];
+
+// Per-batch instance arrays for the batched draw. Object i has pick id i + 1
+// (0 is background), stored directly as 24-bit rgb so decoding is a shift.
+const int instFloats = 19; // column-major model matrix (16) + diffuse rgb (3)
+
+struct ShapeBatch {
+    vector<float> inst;
+    vector<unsigned char> ids; // rgb id + selected flag per instance
+    vector<int> objects;       // scene index per instance
+};
+
+ShapeBatch shapeBatches[batchCount];
+
+// GPU copies of the meshes (positions then normals in one buffer, plus indices),
+// uploaded once, and of the instance arrays, re-sent only when they change. The CPU
+// meshes stay around for ray picking.
+struct ShapeBuffers {
+    GLuint vertices = 0, indices = 0, inst = 0, ids = 0;
+    bool instDirty = true, idsDirty = true;
+};
+
+ShapeBuffers shapeBuffers[batchCount];
+
+// How the shapes reach the GPU. DRAW_GLUT is the original glutSolid* call per object,
+// regenerating every vertex each frame; it is kept only for the benchmark ('b').
+enum DrawPath { DRAW_GLUT = 0, DRAW_CLIENT_ARRAYS = 1, DRAW_VBO = 2 };
+DrawPath drawPath = DRAW_CLIENT_ARRAYS;
+double benchFps[3] = { -1.0, -1.0, -1.0 };
+bool benchOnStart = false; // --bench [objects]: measure on the first frame, print, exit
+int benchObjects = 0;
+
+GLuint instanceProgram = 0;
+GLint instancePickLoc = -1, instanceHighlightLoc = -1;
+
+// Persistent id buffer. When MRT is available display() renders into an offscreen
+// target whose second attachment receives every pixel's pick id, then blits the
+// shaded image to the window. The id image is read back (through a PBO) only when
+// the camera, scene or window size changed, and every pick query until the next
+// change (clicks, hover, region histograms) is answered from that CPU copy. Under
+// MSAA the shading goes to the multisampled target instead, and the ids get a pick
+// pass of their own into this target, drawn only when they are stale.
+struct IdBuffer {
+    GLuint fbo = 0, color = 0, ids = 0, depth = 0, pbo = 0; // color is a texture
+    int w = 0, h = 0;
+    bool ok = false;
+    unsigned long version = 1;     // bumped whenever the id image may have changed
+    unsigned long readVersion = 0; // version whose readback is queued in the pbo
+    unsigned long cpuVersion = 0;  // version held in cpu
+    void* fence = nullptr;
+    vector<unsigned char> cpu;     // rgba per pixel, bottom row first
+    size_t readbacks = 0, queries = 0;
+};
+
+IdBuffer idBuffer;
+bool useIdBuffer = false; // MRT target available and the instanced program is in use
+double idQueryUs = -1.0;
+
+// Drag selection: a left drag selects every object touching a screen rectangle or
+// lasso. Bounding spheres are culled on the CPU against the drag's sub-frustum,
+// then each survivor is drawn offscreen inside an occlusion query restricted to
+// the region (scissor, plus a stencil mask for the lasso). With excludeOccluded
+// the scene's depth is laid down first, so only objects with visible pixels count.
+enum SelectTool { SELECT_RECT = 0, SELECT_LASSO = 1 };
+SelectTool selectTool = SELECT_RECT;
+bool excludeOccluded = true;
+bool dragging = false, dragAdd = false;
+int dragStartX = 0, dragStartY = 0;
+vector<pair<int, int> > dragPath; // window coordinates, top-left origin
+
+struct SelectTarget {
+    GLuint fbo = 0, color = 0, depthStencil = 0;
+    int w = 0, h = 0;
+    bool ok = false;
 };
 
+SelectTarget selectTarget;
+vector<GLuint> selectQueries;
+int selectedCount = 0;
+string selectStats = "-";
+
+// Object under the resting cursor, drawn highlighted
+int hoverX = -1, hoverY = -1;
+int hoveredId = -1;
+
+// Picking backends: GPU color readback (offscreen + asynchronous, or the original
+// blocking full-frame read), CPU ray casting, color and ray side by side, or a
+// lookup in the id buffer written by the normal frame
+enum PickMode { PICK_COLOR = 0, PICK_COLOR_SYNC = 1, PICK_RAY = 2, PICK_COMPARE = 3, PICK_ID_BUFFER = 4 };
+PickMode pickMode = PICK_RAY;
+
+// Offscreen pick target and a small ring of pixel-pack buffers. A pick renders only
+// a scissored box around the cursor and queues its readback; display() collects it
+// on a later frame once the GPU is done, so the click never waits on glFinish.
+const int pickBox = 9;     // scissor edge in pixels, odd so the cursor is centered
+const int pickRingSize = 3;
+
+struct PickTarget {
+    GLuint fbo = 0, color = 0, depth = 0;
+    int w = 0, h = 0;
+    bool ok = false;
+};
+
+struct PendingPick {
+    GLuint pbo = 0;
+    void* fence = nullptr;
+    bool busy = false;
+    unsigned long frame = 0; // frame counter when issued, the fallback when fences are missing
+    std::chrono::steady_clock::time_point issued;
+};
+
+PickTarget pickTarget;
+PendingPick pickRing[pickRingSize];
+
+// Last measured pick cost, shown in the HUD
+double syncPickUs = -1.0;    // blocking full-frame pick, click to result
+double asyncIssueUs = -1.0;  // time the click handler spends queueing the pick
+double asyncResultMs = -1.0; // click to result, including frames waited
+int asyncFrames = 0;
+
 static void randizeObjectColor(int id) {
-    objColor[id][0] = 0.2f + 0.8f * (rand() / static_cast<float>(RAND_MAX));
-    objColor[id][1] = 0.2f + 0.8f * (rand() / static_cast<float>(RAND_MAX));
-    objColor[id][2] = 0.2f + 0.8f * (rand() / static_cast<float>(RAND_MAX));
+    sceneObjects[id].color[0] = 0.2f + 0.8f * (rand() / static_cast<float>(RAND_MAX));
+    sceneObjects[id].color[1] = 0.2f + 0.8f * (rand() / static_cast<float>(RAND_MAX));
+    sceneObjects[id].color[2] = 0.2f + 0.8f * (rand() / static_cast<float>(RAND_MAX));
+}
+
+static void encodePickId(int index, unsigned char* rgb) {
+    uint32_t id = static_cast<uint32_t>(index) + 1;
+    rgb[0] = static_cast<unsigned char>(id & 0xff);
+    rgb[1] = static_cast<unsigned char>((id >> 8) & 0xff);
+    rgb[2] = static_cast<unsigned char>((id >> 16) & 0xff);
+}
+
+// Scene index for a pick pixel, or -1 for background
+static int decodePickColor(const unsigned char* pixel) {
+    int id = pixel[0] | (pixel[1] << 8) | (pixel[2] << 16);
+    return (id > 0 && id <= static_cast<int>(sceneObjects.size())) ? id - 1 : -1;
+}
+
+// The original layout for count <= 3, otherwise a jittered cubic grid of random shapes
+static void buildScene(int count) {
+    sceneObjects.clear();
+    if (count <= 3) {
+        static const float baseColor[3][3] = {
+            {0.8f, 0.2f, 0.2f}, // obj 0
+            {0.2f, 0.8f, 0.2f}, // obj 1
+            {0.2f, 0.2f, 0.8f}  // obj 2
+        };
+        static const float offsetX[3] = { -2.2f, 0.0f, 2.2f };
+        for (int id = 0; id < 3; ++id) {
+            SceneObject o = { static_cast<ShapeType>(id), Vec3(offsetX[id], 0, 0), -20.0f, id * 30.0f, 1.0f,
+                { baseColor[id][0], baseColor[id][1], baseColor[id][2] }, 0, false, 0 };
+            sceneObjects.push_back(o);
+        }
+    }
+    else {
+        int side = static_cast<int>(ceil(cbrt(static_cast<double>(count))));
+        const float spacing = 1.0f;
+        float half = (side - 1) * spacing * 0.5f;
+        for (int k = 0; k < count; ++k) {
+            SceneObject o;
+            o.shape = static_cast<ShapeType>(rand() % SHAPE_COUNT);
+            o.pos = Vec3((k % side) * spacing - half, ((k / side) % side) * spacing - half, (k / (side * side)) * spacing - half);
+            o.tilt = -30.0f + 60.0f * (rand() / static_cast<float>(RAND_MAX));
+            o.yaw = 360.0f * (rand() / static_cast<float>(RAND_MAX));
+            o.scale = 0.35f;
+            o.slot = 0;
+            o.selected = false;
+            o.lod = 0;
+            sceneObjects.push_back(o);
+            randizeObjectColor(k);
+        }
+    }
+    sceneDirty = true;
+}
+
+// Column-major world matrix of one object, matching its glTranslate/glRotate/glScale order
+static void objectMatrix(const SceneObject& o, float m[16]) {
+    float a = o.tilt * static_cast<float>(M_PI) / 180.0f, b = o.yaw * static_cast<float>(M_PI) / 180.0f;
+    float ca = cosf(a), sa = sinf(a), cb = cosf(b), sb = sinf(b), s = o.scale;
+    // rotX(a) * rotY(b), columns scaled by s
+    m[0] = cb * s;       m[1] = sa * sb * s;  m[2] = -ca * sb * s; m[3] = 0;
+    m[4] = 0;            m[5] = ca * s;       m[6] = sa * s;       m[7] = 0;
+    m[8] = sb * s;       m[9] = -sa * cb * s; m[10] = ca * cb * s; m[11] = 0;
+    m[12] = o.pos.x;     m[13] = o.pos.y;     m[14] = o.pos.z;     m[15] = 1;
 }
 
+static int batchIndex(const SceneObject& o) {
+    return o.shape * lodLevels + o.lod;
+}
+
+static void rebuildBatches() {
+    for (int s = 0; s < batchCount; s++) {
+        shapeBatches[s].inst.clear();
+        shapeBatches[s].ids.clear();
+        shapeBatches[s].objects.clear();
+    }
+    for (size_t i = 0; i < sceneObjects.size(); i++) {
+        SceneObject& o = sceneObjects[i];
+        ShapeBatch& b = shapeBatches[batchIndex(o)];
+        o.slot = static_cast<int>(b.objects.size());
+        b.objects.push_back(static_cast<int>(i));
+        float m[16];
+        objectMatrix(o, m);
+        b.inst.insert(b.inst.end(), m, m + 16);
+        b.inst.insert(b.inst.end(), o.color, o.color + 3);
+        unsigned char id[4] = { 0, 0, 0, 0 };
+        encodePickId(static_cast<int>(i), id);
+        id[3] = o.selected ? 255 : 0;
+        b.ids.insert(b.ids.end(), id, id + 4);
+    }
+    for (int s = 0; s < batchCount; s++) shapeBuffers[s].instDirty = shapeBuffers[s].idsDirty = true;
+    sceneDirty = false;
+}
+
+static void updateBatchSelection(int index) {
+    const SceneObject& o = sceneObjects[index];
+    if (sceneDirty) return;
+    shapeBatches[batchIndex(o)].ids[o.slot * 4 + 3] = o.selected ? 255 : 0;
+    shapeBuffers[batchIndex(o)].idsDirty = true; // whole array re-sent once, however many changed
+}
+
+// Copy an object's color into its batch after a recolor
+static void updateBatchColor(int index) {
+    const SceneObject& o = sceneObjects[index];
+    if (sceneDirty) return; // the rebuild picks it up
+    float* dst = &shapeBatches[batchIndex(o)].inst[o.slot * instFloats + 16];
+    dst[0] = o.color[0];
+    dst[1] = o.color[1];
+    dst[2] = o.color[2];
+    const ShapeBuffers& sb = shapeBuffers[batchIndex(o)];
+    if (sb.inst && !sb.instDirty) {
+        glExt.BindBuffer(GL_ARRAY_BUFFER, sb.inst);
+        glExt.BufferSubData(GL_ARRAY_BUFFER, (o.slot * instFloats + 16) * sizeof(float), 3 * sizeof(float), dst);
+        glExt.BindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+// Rebuild stale batches and send changed instance arrays to their buffers
+static void prepareBatches() {
+    if (sceneDirty) rebuildBatches();
+    if (drawPath != DRAW_VBO || !instanceProgram) return;
+    const GLExt& gl = glExt;
+    for (int s = 0; s < batchCount; s++) {
+        ShapeBuffers& sb = shapeBuffers[s];
+        const ShapeBatch& b = shapeBatches[s];
+        if (!sb.inst) gl.GenBuffers(1, &sb.inst);
+        if (!sb.ids) gl.GenBuffers(1, &sb.ids);
+        if (sb.instDirty) {
+            gl.BindBuffer(GL_ARRAY_BUFFER, sb.inst);
+            gl.BufferData(GL_ARRAY_BUFFER, b.inst.size() * sizeof(float), b.inst.data(), GL_DYNAMIC_DRAW);
+            sb.instDirty = false;
+        }
+        if (sb.idsDirty) {
+            gl.BindBuffer(GL_ARRAY_BUFFER, sb.ids);
+            gl.BufferData(GL_ARRAY_BUFFER, b.ids.size(), b.ids.data(), GL_DYNAMIC_DRAW);
+            sb.idsDirty = false;
+        }
+    }
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Byte offset into the bound buffer, in the pointer form gl*Pointer takes
+static const void* bufferOffset(size_t bytes) {
+    return reinterpret_cast<const void*>(bytes);
+}
+
+// Point the vertex arrays at batch s (generic attributes 0/1 for the instanced
+// program, the fixed-function arrays otherwise) and bind its indices. Returns the
+// index pointer for the draw call.
+static const void* bindShapeMesh(int s, bool attribs) {
+    const ShapeMesh& m = shapeMeshes[s];
+    const ShapeBuffers& sb = shapeBuffers[s];
+    bool vbo = drawPath == DRAW_VBO && sb.vertices;
+    const void* pos = vbo ? bufferOffset(0) : m.pos.data();
+    const void* nrm = vbo ? bufferOffset(m.pos.size() * sizeof(float)) : m.nrm.data();
+    if (glExt.vbo) {
+        glExt.BindBuffer(GL_ARRAY_BUFFER, vbo ? sb.vertices : 0);
+        glExt.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo ? sb.indices : 0);
+    }
+    if (attribs) {
+        glExt.VertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, pos);
+        glExt.VertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nrm);
+    }
+    else {
+        glVertexPointer(3, GL_FLOAT, 0, pos);
+        glNormalPointer(GL_FLOAT, 0, nrm);
+    }
+    return vbo ? bufferOffset(0) : m.idx.data();
+}
+
+// Per-instance attributes 2-7 of batch s, starting at instance `first`
+static void bindShapeInstances(int s, size_t first) {
+    const GLExt& gl = glExt;
+    const ShapeBatch& b = shapeBatches[s];
+    const ShapeBuffers& sb = shapeBuffers[s];
+    const GLsizei stride = instFloats * sizeof(float);
+    bool vbo = drawPath == DRAW_VBO && sb.inst;
+    uintptr_t inst = (vbo ? 0 : reinterpret_cast<uintptr_t>(b.inst.data())) + first * stride;
+    uintptr_t ids = (vbo ? 0 : reinterpret_cast<uintptr_t>(b.ids.data())) + first * 4;
+    if (gl.vbo) gl.BindBuffer(GL_ARRAY_BUFFER, vbo ? sb.inst : 0);
+    for (GLuint c = 0; c < 4; c++)
+        gl.VertexAttribPointer(2 + c, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(inst + c * 4 * sizeof(float)));
+    gl.VertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(inst + 16 * sizeof(float)));
+    if (gl.vbo) gl.BindBuffer(GL_ARRAY_BUFFER, vbo ? sb.ids : 0);
+    gl.VertexAttribPointer(7, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4, reinterpret_cast<const void*>(ids));
+}
+
+// Client-side arrays (the HUD, glutSolid*) must not see our buffers
+static void unbindShapeBuffers() {
+    if (!glExt.vbo) return;
+    glExt.BindBuffer(GL_ARRAY_BUFFER, 0);
+    glExt.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// The original full-detail GLUT call for batch s's shape
+static void drawGlutShape(int s) {
+    switch (s / lodLevels) {
+    case SHAPE_SPHERE: glutSolidSphere(0.9, 48, 48); break;
+    case SHAPE_TORUS: glutSolidTorus(0.25, 0.85, 48, 48); break;
+    case SHAPE_TEAPOT: glutSolidTeapot(0.8); break;
+    }
+}
+
+
 static void setupCameraAndLight() {
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
@@ -75,71 +474,647 @@ static void drawScene(bool pickMode = false) {
         glDisable(GL_LIGHTING);
         glShadeModel(GL_FLAT);
         glDisable(GL_DITHER);
-        glDisable(GL_LINE_SMOOTH);
-        glDisable(GL_POLYGON_SMOOTH);
-        glDisable(GL_BLEND);
     }
     else {
         glEnable(GL_LIGHTING);
         glShadeModel(GL_SMOOTH);
         glEnable(GL_DITHER);
-        if (useAA) {
-            glEnable(GL_LINE_SMOOTH);
-            glEnable(GL_POLYGON_SMOOTH);
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    prepareBatches();
+    if (instanceProgram && drawPath != DRAW_GLUT) {
+        const GLExt& gl = glExt;
+        gl.UseProgram(instanceProgram);
+        gl.Uniform1i(instancePickLoc, pickMode ? 1 : 0);
+        unsigned char hl[3] = { 0, 0, 0 };
+        if (hoveredId >= 0 && !pickMode) encodePickId(hoveredId, hl);
+        gl.Uniform3f(instanceHighlightLoc, hl[0] / 255.0f, hl[1] / 255.0f, hl[2] / 255.0f);
+        for (GLuint a = 0; a < 8; a++) gl.EnableVertexAttribArray(a);
+        for (GLuint a = 2; a < 8; a++) gl.VertexAttribDivisor(a, 1);
+        for (int s = 0; s < batchCount; s++) {
+            const ShapeBatch& b = shapeBatches[s];
+            if (b.objects.empty()) continue;
+            const void* indices = bindShapeMesh(s, true);
+            bindShapeInstances(s, 0);
+            gl.DrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(shapeMeshes[s].idx.size()), GL_UNSIGNED_INT, indices,
+                static_cast<GLsizei>(b.objects.size()));
         }
-        else {
-            glDisable(GL_LINE_SMOOTH);
-            glDisable(GL_POLYGON_SMOOTH);
-            glDisable(GL_BLEND);
+        unbindShapeBuffers();
+        for (GLuint a = 2; a < 8; a++) gl.VertexAttribDivisor(a, 0);
+        for (GLuint a = 0; a < 8; a++) gl.DisableVertexAttribArray(a);
+        gl.UseProgram(0);
+        return;
+    }
+
+    // No instancing: one matrix and one indexed draw per object from the shared meshes
+    // (or, for the benchmark, one glutSolid* call per object)
+    bool glut = drawPath == DRAW_GLUT;
+    if (!glut) {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+    }
+    for (int s = 0; s < batchCount; s++) {
+        const ShapeMesh& m = shapeMeshes[s];
+        const ShapeBatch& b = shapeBatches[s];
+        if (b.objects.empty()) continue;
+        const void* indices = glut ? nullptr : bindShapeMesh(s, false);
+        for (size_t k = 0; k < b.objects.size(); k++) {
+            const float* inst = &b.inst[k * instFloats];
+            glPushMatrix();
+            glMultMatrixf(inst);
+            if (pickMode) {
+                glColor3ubv(&b.ids[k * 4]);
+            }
+            else {
+                GLfloat diffuse[4] = { inst[16], inst[17], inst[18], 1.0f };
+                GLfloat spec[4] = { 0.3f, 0.3f, 0.3f, 1.0f };
+                GLfloat ambient[4] = { 0.08f, 0.08f, 0.08f, 1.0f };
+                glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, diffuse);
+                glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, spec);
+                glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, ambient);
+                glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, 32.0f);
+                float glow = (b.objects[k] == hoveredId) ? 0.25f : 0.0f;
+                bool selected = b.ids[k * 4 + 3] != 0;
+                GLfloat emission[4] = { glow + (selected ? 0.45f : 0.0f), glow + (selected ? 0.38f : 0.0f), glow, 1.0f };
+                glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, emission);
+            }
+            if (glut) drawGlutShape(s);
+            else glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(m.idx.size()), GL_UNSIGNED_INT, indices);
+            glPopMatrix();
         }
     }
+    if (!glut) {
+        unbindShapeBuffers();
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+    }
+    GLfloat noEmission[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, noEmission);
+}
 
-    for (int id = 0; id < 3; ++id) {
-        glPushMatrix();
+// ---- Shape meshes -----------------------------------------------------------
+
+// Same parametrisation as glutSolidSphere: poles on z, seam duplicated
+static void buildSphereMesh(ShapeMesh& m, float radius, int slices, int stacks) {
+    for (int i = 0; i <= stacks; i++) {
+        float phi = static_cast<float>(M_PI) * i / stacks;
+        for (int j = 0; j <= slices; j++) {
+            float theta = 2.0f * static_cast<float>(M_PI) * j / slices;
+            float n[3] = { sinf(phi) * cosf(theta), sinf(phi) * sinf(theta), cosf(phi) };
+            m.nrm.insert(m.nrm.end(), n, n + 3);
+            m.pos.push_back(n[0] * radius);
+            m.pos.push_back(n[1] * radius);
+            m.pos.push_back(n[2] * radius);
+        }
+    }
+    for (int i = 0; i < stacks; i++)
+        for (int j = 0; j < slices; j++) {
+            uint32_t a = i * (slices + 1) + j, b = a + slices + 1;
+            uint32_t q[6] = { a, b, b + 1, a, b + 1, a + 1 };
+            m.idx.insert(m.idx.end(), q, q + 6);
+        }
+    m.radius = radius;
+}
+
+// Same parametrisation as glutSolidTorus: ring about the z axis
+static void buildTorusMesh(ShapeMesh& m, float inner, float outer, int sides, int rings) {
+    for (int i = 0; i <= rings; i++) {
+        float theta = 2.0f * static_cast<float>(M_PI) * i / rings;
+        for (int j = 0; j <= sides; j++) {
+            float phi = 2.0f * static_cast<float>(M_PI) * j / sides;
+            float n[3] = { cosf(phi) * cosf(theta), cosf(phi) * sinf(theta), sinf(phi) };
+            m.nrm.insert(m.nrm.end(), n, n + 3);
+            m.pos.push_back((outer + inner * cosf(phi)) * cosf(theta));
+            m.pos.push_back((outer + inner * cosf(phi)) * sinf(theta));
+            m.pos.push_back(inner * sinf(phi));
+        }
+    }
+    for (int i = 0; i < rings; i++)
+        for (int j = 0; j < sides; j++) {
+            uint32_t a = i * (sides + 1) + j, b = a + sides + 1;
+            uint32_t q[6] = { a, b, b + 1, a, b + 1, a + 1 };
+            m.idx.insert(m.idx.end(), q, q + 6);
+        }
+    m.radius = outer + inner;
+}
+
+#ifndef GL_NORMAL_MAP
+#define GL_NORMAL_MAP 0x8511
+#endif
+
+// GLUT has no closed form for the teapot, so its triangles are captured once from
+// glutSolidTeapot through GL feedback. Normals ride along in the texture
+// coordinates via GL_NORMAL_MAP texgen; vertices are welded on (position, normal).
+static void captureTeapotMesh(ShapeMesh& m, double size) {
+    const int S = 1024;       // feedback viewport size
+    const float E = 4.0f;     // ortho half-extent in object units
+    const int stride = 11;    // GL_3D_COLOR_TEXTURE: xyz, rgba, strq
+    vector<GLfloat> buf(1 << 21);
+
+    glPushAttrib(GL_VIEWPORT_BIT | GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_TRANSFORM_BIT);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_LIGHTING);
+    glEnable(GL_NORMALIZE);
+    glViewport(0, 0, S, S);
+    GLenum coords[3] = { GL_S, GL_T, GL_R };
+    GLenum gens[3] = { GL_TEXTURE_GEN_S, GL_TEXTURE_GEN_T, GL_TEXTURE_GEN_R };
+    for (int k = 0; k < 3; k++) {
+        glTexGeni(coords[k], GL_TEXTURE_GEN_MODE, GL_NORMAL_MAP);
+        glEnable(gens[k]);
+    }
+    glMatrixMode(GL_TEXTURE);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(-E, E, -E, E, -E, E);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
 
-        if (id == 0) glTranslatef(-2.2f, 0.0f, 0.0f);
-        if (id == 1) glTranslatef(0.0f, 0.0f, 0.0f);
-        if (id == 2) glTranslatef(2.2f, 0.0f, 0.0f);
+    glFeedbackBuffer(static_cast<GLsizei>(buf.size()), GL_3D_COLOR_TEXTURE, buf.data());
+    glRenderMode(GL_FEEDBACK);
+    glutSolidTeapot(size);
+    int n = glRenderMode(GL_RENDER);
 
-        glRotatef(-20.0f, 1.0f, 0.0f, 0.0f);
-        glRotatef(static_cast<float>(id * 30), 0.0f, 1.0f, 0.0f);
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_TEXTURE);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
 
-        if (pickMode) {
-            glColor3ub(pickColorBytes[id][0], pickColorBytes[id][1], pickColorBytes[id][2]);
-            if (id == 0) glutSolidSphere(0.9, 48, 48);
-            else if (id == 1) glutSolidTorus(0.25, 0.85, 48, 48);
-            else glutSolidTeapot(0.8);
+    if (n < 0) {
+        cout << "Teapot feedback buffer overflow; teapot will not be drawn\n";
+        return;
+    }
+    map<array<int, 6>, uint32_t> weld;
+    auto vertexAt = [&](int i) {
+        float p[3] = { (buf[i] * 2.0f / S - 1.0f) * E, (buf[i + 1] * 2.0f / S - 1.0f) * E, -(buf[i + 2] * 2.0f - 1.0f) * E };
+        const float* nr = &buf[i + 7];
+        array<int, 6> key;
+        for (int k = 0; k < 3; k++) {
+            key[k] = static_cast<int>(lroundf(p[k] * 1e4f));
+            key[k + 3] = static_cast<int>(lroundf(nr[k] * 1e3f));
         }
+        map<array<int, 6>, uint32_t>::iterator it = weld.find(key);
+        if (it != weld.end()) return it->second;
+        uint32_t index = static_cast<uint32_t>(m.pos.size() / 3);
+        m.pos.insert(m.pos.end(), p, p + 3);
+        m.nrm.insert(m.nrm.end(), nr, nr + 3);
+        m.radius = max(m.radius, sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]));
+        weld[key] = index;
+        return index;
+    };
+    for (int i = 0; i < n;) {
+        GLint token = static_cast<GLint>(buf[i++]);
+        if (token == GL_POLYGON_TOKEN) {
+            int count = static_cast<int>(buf[i++]);
+            uint32_t v0 = vertexAt(i), prev = vertexAt(i + stride);
+            for (int k = 2; k < count; k++) {
+                uint32_t v = vertexAt(i + k * stride);
+                if (v0 != prev && prev != v && v != v0) {
+                    m.idx.push_back(v0);
+                    m.idx.push_back(prev);
+                    m.idx.push_back(v);
+                }
+                prev = v;
+            }
+            i += count * stride;
+        }
+        else if (token == GL_LINE_TOKEN || token == GL_LINE_RESET_TOKEN) i += 2 * stride;
+        else if (token == GL_PASS_THROUGH_TOKEN) i += 1;
+        else i += stride; // point, bitmap and pixel tokens carry one vertex
+    }
+}
+
+// Headless runs have no GLUT to capture the teapot from, so they tessellate the same
+// Newell patches directly and place them the way glutSolidTeapot does
+static void tessellateTeapotMesh(ShapeMesh& m, float size) {
+    const int N = 13; // samples per patch side
+    BezierModel model;
+    teapotModel(model);
+    WorkStealingPool pool(1);
+    ModelMesh patches;
+    tessellateModel(model, N, batchDetectKernel(), pool, patches);
+    // GLUT's frame: rotated -90 degrees about x, scaled by size / 2, lowered by 1.5 units
+    float s = 0.5f * size;
+    size_t count = patches.pos.size() / 3;
+    m.pos.resize(count * 3);
+    m.nrm.resize(count * 3);
+    for (size_t v = 0; v < count; v++) {
+        const float* p = &patches.pos[v * 3];
+        const float* n = &patches.nrm[v * 3];
+        float q[3] = { p[0] * s, (p[2] - 1.5f) * s, -p[1] * s };
+        float r[3] = { n[0], n[2], -n[1] };
+        memcpy(&m.pos[v * 3], q, sizeof(q));
+        memcpy(&m.nrm[v * 3], r, sizeof(r));
+        m.radius = max(m.radius, sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2]));
+    }
+    m.idx.assign(patches.idx.begin(), patches.idx.end());
+}
+
+// Vertex clustering: every vertex snaps to the average of its cell on a `cell`-sized
+// grid, normals are averaged, and triangles that collapse are dropped
+static void clusterMesh(const ShapeMesh& src, float cell, ShapeMesh& dst) {
+    map<array<int, 3>, uint32_t> cells;
+    vector<uint32_t> remap(src.pos.size() / 3);
+    vector<float> sum, nsum;
+    vector<int> count;
+    for (size_t v = 0; v < remap.size(); v++) {
+        const float* p = &src.pos[v * 3];
+        array<int, 3> key = { { static_cast<int>(floorf(p[0] / cell)), static_cast<int>(floorf(p[1] / cell)),
+            static_cast<int>(floorf(p[2] / cell)) } };
+        map<array<int, 3>, uint32_t>::iterator it = cells.find(key);
+        uint32_t c;
+        if (it != cells.end()) c = it->second;
         else {
-            GLfloat diffuse[4] = { objColor[id][0], objColor[id][1], objColor[id][2], 1.0f };
-            GLfloat spec[4] = { 0.3f, 0.3f, 0.3f, 1.0f };
-            GLfloat ambient[4] = { 0.08f, 0.08f, 0.08f, 1.0f };
-            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, diffuse);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, spec);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, ambient);
-            glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, 32.0f);
+            c = static_cast<uint32_t>(count.size());
+            cells[key] = c;
+            count.push_back(0);
+            sum.insert(sum.end(), 3, 0.0f);
+            nsum.insert(nsum.end(), 3, 0.0f);
+        }
+        for (int k = 0; k < 3; k++) {
+            sum[c * 3 + k] += p[k];
+            nsum[c * 3 + k] += src.nrm[v * 3 + k];
+        }
+        count[c]++;
+        remap[v] = c;
+    }
+    dst.pos.resize(sum.size());
+    dst.nrm.resize(nsum.size());
+    dst.radius = src.radius;
+    for (size_t c = 0; c < count.size(); c++) {
+        float* n = &nsum[c * 3];
+        float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (int k = 0; k < 3; k++) {
+            dst.pos[c * 3 + k] = sum[c * 3 + k] / count[c];
+            dst.nrm[c * 3 + k] = len > 0 ? n[k] / len : 0.0f;
+        }
+    }
+    dst.idx.clear();
+    for (size_t t = 0; t + 2 < src.idx.size(); t += 3) {
+        uint32_t a = remap[src.idx[t]], b = remap[src.idx[t + 1]], c = remap[src.idx[t + 2]];
+        if (a == b || b == c || c == a) continue;
+        dst.idx.push_back(a);
+        dst.idx.push_back(b);
+        dst.idx.push_back(c);
+    }
+}
+
+// Instanced shading: fixed-function light 0 and the material of the per-object
+// path, evaluated per vertex; the pick pass writes the instance id color instead
+static const char* instanceVS =
+    "#version 120\n"
+    "attribute vec3 position;\n"
+    "attribute vec3 normal;\n"
+    "attribute vec4 model0;\n"
+    "attribute vec4 model1;\n"
+    "attribute vec4 model2;\n"
+    "attribute vec4 model3;\n"
+    "attribute vec3 diffuse;\n"
+    "attribute vec4 pickId; // rgb id, a = selected\n"
+    "uniform int pickPass;\n"
+    "uniform vec3 highlight;\n"
+    "varying vec3 shade;\n"
+    "varying vec3 id;\n"
+    "invariant gl_Position; // selection queries redraw objects over this depth\n"
+    "void main() {\n"
+    "    mat4 model = mat4(model0, model1, model2, model3);\n"
+    "    vec4 eye = gl_ModelViewMatrix * (model * vec4(position, 1.0));\n"
+    "    gl_Position = gl_ProjectionMatrix * eye;\n"
+    "    id = pickId.rgb;\n"
+    "    if (pickPass != 0) { shade = pickId.rgb; return; }\n"
+    "    vec3 n = normalize(gl_NormalMatrix * (mat3(model) * normal));\n"
+    "    vec3 l = normalize(gl_LightSource[0].position.xyz - eye.xyz);\n"
+    "    vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));\n"
+    "    float nl = max(dot(n, l), 0.0);\n"
+    "    float spec = nl > 0.0 ? pow(max(dot(n, h), 0.0), 32.0) : 0.0;\n"
+    "    shade = vec3(0.08) * (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb)\n"
+    "          + diffuse * gl_LightSource[0].diffuse.rgb * nl\n"
+    "          + vec3(0.3) * gl_LightSource[0].specular.rgb * spec;\n"
+    "    if (distance(pickId.rgb, highlight) < 0.5 / 255.0) shade += vec3(0.25);\n"
+    "    if (pickId.a > 0.5) shade = mix(shade, vec3(1.0, 0.85, 0.2), 0.45);\n"
+    "}\n";
 
-            if (id == 0) glutSolidSphere(0.9, 48, 48);
-            else if (id == 1) glutSolidTorus(0.25, 0.85, 48, 48);
-            else glutSolidTeapot(0.8);
+static const char* instanceFS =
+    "#version 120\n"
+    "varying vec3 shade;\n"
+    "varying vec3 id;\n"
+    "void main() {\n"
+    "    gl_FragData[0] = vec4(shade, 1.0);\n"
+    "    gl_FragData[1] = vec4(id, 1.0); // only lands when the id attachment is bound\n"
+    "}\n";
+
+static void uploadShapeMeshes() {
+    const GLExt& gl = glExt;
+    for (int s = 0; s < batchCount; s++) {
+        const ShapeMesh& m = shapeMeshes[s];
+        ShapeBuffers& sb = shapeBuffers[s];
+        size_t posBytes = m.pos.size() * sizeof(float);
+        gl.GenBuffers(1, &sb.vertices);
+        gl.BindBuffer(GL_ARRAY_BUFFER, sb.vertices);
+        gl.BufferData(GL_ARRAY_BUFFER, 2 * posBytes, nullptr, GL_STATIC_DRAW);
+        gl.BufferSubData(GL_ARRAY_BUFFER, 0, posBytes, m.pos.data());
+        gl.BufferSubData(GL_ARRAY_BUFFER, posBytes, posBytes, m.nrm.data());
+        gl.GenBuffers(1, &sb.indices);
+        gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, sb.indices);
+        gl.BufferData(GL_ELEMENT_ARRAY_BUFFER, m.idx.size() * sizeof(uint32_t), m.idx.data(), GL_STATIC_DRAW);
+    }
+    unbindShapeBuffers();
+}
+
+static void initShapes() {
+    for (int l = 0; l < lodLevels; l++) {
+        buildSphereMesh(shapeMeshes[SHAPE_SPHERE * lodLevels + l], 0.9f, lodSegments[l], lodSegments[l]);
+        buildTorusMesh(shapeMeshes[SHAPE_TORUS * lodLevels + l], 0.25f, 0.85f, lodSegments[l], lodSegments[l]);
+    }
+    ShapeMesh& teapot = shapeMeshes[SHAPE_TEAPOT * lodLevels];
+    if (headless.active) tessellateTeapotMesh(teapot, 0.8f);
+    else captureTeapotMesh(teapot, 0.8);
+    for (int l = 1; l < lodLevels; l++) {
+        // the largest cell that keeps the sphere's triangle ratio for this level
+        float ratio = static_cast<float>(lodSegments[l]) / lodSegments[0];
+        size_t budget = static_cast<size_t>(teapot.idx.size() * ratio * ratio);
+        float lo = 0.0f, hi = teapot.radius;
+        for (int it = 0; it < 16; it++) {
+            float mid = 0.5f * (lo + hi);
+            clusterMesh(teapot, mid, shapeMeshes[SHAPE_TEAPOT * lodLevels + l]);
+            if (shapeMeshes[SHAPE_TEAPOT * lodLevels + l].idx.size() > budget) lo = mid;
+            else hi = mid;
         }
+        clusterMesh(teapot, hi, shapeMeshes[SHAPE_TEAPOT * lodLevels + l]);
+    }
 
-        glPopMatrix();
+    const GLExt& gl = glExtInit();
+    if (gl.instancing) {
+        static const char* attribs[] = { "position", "normal", "model0", "model1", "model2", "model3",
+            "diffuse", "pickId", nullptr };
+        instanceProgram = glExtBuildProgram(instanceVS, instanceFS, attribs);
+        if (instanceProgram) {
+            instancePickLoc = gl.GetUniformLocation(instanceProgram, "pickPass");
+            instanceHighlightLoc = gl.GetUniformLocation(instanceProgram, "highlight");
+        }
+    }
+    if (gl.vbo) {
+        uploadShapeMeshes();
+        drawPath = DRAW_VBO;
     }
+    useIdBuffer = instanceProgram && gl.fbo && gl.blit && gl.pbo;
+    cout << "Scene draw path: " << (instanceProgram ? "instanced, one draw per shape" : "one indexed draw per object")
+        << (drawPath == DRAW_VBO ? ", meshes in VBOs" : ", meshes in client arrays") << "\n";
+    cout << "Id buffer: " << (useIdBuffer ? "written every frame" : "unavailable, picks render their own pass") << "\n";
 }
 
-static void pickAt(int mx, int my) {
-    glDrawBuffer(GL_BACK);
-    glReadBuffer(GL_BACK);
+// ---- CPU ray picking -------------------------------------------------------
+
+static Vec3 crossp(const Vec3& a, const Vec3& b) {
+    return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static float dotp(const Vec3& a, const Vec3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Vec3 normalize(const Vec3& v) {
+    float L = sqrtf(dotp(v, v));
+    return (L > 1e-6f) ? v * (1.0f / L) : v;
+}
+
+struct Ray {
+    Vec3 o, d;
+};
+
+// Camera frame of setupCameraAndLight(): eye, forward, right, up, and the
+// half-extents of the view plane at unit depth
+struct CameraFrame {
+    Vec3 eye, f, s, u;
+    float tanHalfX, tanHalfY;
+};
+
+static CameraFrame cameraFrame() {
+    float az = camAz * static_cast<float>(M_PI) / 180.0f;
+    float el = camEl * static_cast<float>(M_PI) / 180.0f;
+    Vec3 center(camCenterX, camCenterY, camCenterZ);
+    CameraFrame c;
+    c.eye = center + Vec3(cosf(el) * cosf(az), sinf(el), cosf(el) * sinf(az)) * camDist;
+    c.f = normalize(center - c.eye);
+    c.s = normalize(crossp(c.f, Vec3(0, 1, 0)));
+    c.u = crossp(c.s, c.f);
+    c.tanHalfY = tanf(55.0f * 0.5f * static_cast<float>(M_PI) / 180.0f);
+    c.tanHalfX = c.tanHalfY * static_cast<float>(winW) / static_cast<float>(winH);
+    return c;
+}
+
+// Eye ray through pixel (mx, my)
+static Ray cameraRay(int mx, int my) {
+    CameraFrame c = cameraFrame();
+    float px = (2.0f * (mx + 0.5f) / winW - 1.0f) * c.tanHalfX;
+    float py = (1.0f - 2.0f * (my + 0.5f) / winH) * c.tanHalfY;
+    Ray r;
+    r.o = c.eye;
+    r.d = normalize(c.f + c.s * px + c.u * py);
+    return r;
+}
+
+static Vec3 rotateX(const Vec3& v, float deg) {
+    float a = deg * static_cast<float>(M_PI) / 180.0f, c = cosf(a), s = sinf(a);
+    return Vec3(v.x, c * v.y - s * v.z, s * v.y + c * v.z);
+}
+
+static Vec3 rotateY(const Vec3& v, float deg) {
+    float a = deg * static_cast<float>(M_PI) / 180.0f, c = cosf(a), s = sinf(a);
+    return Vec3(c * v.x + s * v.z, v.y, -s * v.x + c * v.z);
+}
+
+// World ray into the local frame of an object (inverse of its world matrix). The
+// direction stays unit length, so a local hit at t is a world hit at t * scale.
+static Ray toObjectSpace(const Ray& r, const SceneObject& o) {
+    Ray l;
+    l.o = rotateY(rotateX(r.o - o.pos, -o.tilt), -o.yaw) * (1.0f / o.scale);
+    l.d = rotateY(rotateX(r.d, -o.tilt), -o.yaw);
+    return l;
+}
+
+const float pickNear = 0.1f; // matches the gluPerspective near plane
+
+// Triangles of one shape at one LOD level in object space, taken from the drawn mesh so
+// the CPU picker tests exactly the geometry on screen; indexed like shapeMeshes and
+// built on first use.
+struct PickTri {
+    Vec3 a, b, c;
+};
+
+struct BvhNode {
+    Vec3 lo, hi;
+    int left, right;  // children, -1 for a leaf
+    int first, count; // triangle range for leaves
+};
+
+struct PickMesh {
+    std::vector<PickTri> tris;
+    std::vector<BvhNode> bvh;
+};
+
+PickMesh pickMeshes[batchCount];
+
+static void collectPickTriangles(int s) {
+    const ShapeMesh& m = shapeMeshes[s];
+    std::vector<PickTri>& tris = pickMeshes[s].tris;
+    tris.clear();
+    for (size_t k = 0; k + 2 < m.idx.size(); k += 3) {
+        const float* a = &m.pos[m.idx[k] * 3];
+        const float* b = &m.pos[m.idx[k + 1] * 3];
+        const float* c = &m.pos[m.idx[k + 2] * 3];
+        PickTri t = { Vec3(a[0], a[1], a[2]), Vec3(b[0], b[1], b[2]), Vec3(c[0], c[1], c[2]) };
+        tris.push_back(t);
+    }
+}
+
+static int buildBvh(PickMesh& m, int first, int count) {
+    BvhNode node;
+    node.lo = Vec3(1e30f, 1e30f, 1e30f);
+    node.hi = Vec3(-1e30f, -1e30f, -1e30f);
+    for (int i = first; i < first + count; i++) {
+        const Vec3* v[3] = { &m.tris[i].a, &m.tris[i].b, &m.tris[i].c };
+        for (int k = 0; k < 3; k++) {
+            node.lo = Vec3(std::min(node.lo.x, v[k]->x), std::min(node.lo.y, v[k]->y), std::min(node.lo.z, v[k]->z));
+            node.hi = Vec3(std::max(node.hi.x, v[k]->x), std::max(node.hi.y, v[k]->y), std::max(node.hi.z, v[k]->z));
+        }
+    }
+    node.left = node.right = -1;
+    node.first = first;
+    node.count = count;
+    int index = static_cast<int>(m.bvh.size());
+    m.bvh.push_back(node);
+    if (count <= 4) return index;
+
+    // median split on the longest axis of the box
+    Vec3 ext = node.hi - node.lo;
+    int axis = (ext.x > ext.y && ext.x > ext.z) ? 0 : (ext.y > ext.z ? 1 : 2);
+    auto centroid = [axis](const PickTri& t) {
+        const float* a = &t.a.x; const float* b = &t.b.x; const float* c = &t.c.x;
+        return a[axis] + b[axis] + c[axis];
+    };
+    int half = count / 2;
+    std::nth_element(m.tris.begin() + first, m.tris.begin() + first + half, m.tris.begin() + first + count,
+        [&](const PickTri& p, const PickTri& q) { return centroid(p) < centroid(q); });
+    int left = buildBvh(m, first, half);
+    int right = buildBvh(m, first + half, count - half);
+    m.bvh[index].left = left;
+    m.bvh[index].right = right;
+    m.bvh[index].count = 0;
+    return index;
+}
+
+static bool rayHitsBox(const Ray& r, const Vec3& inv, const Vec3& lo, const Vec3& hi, float tMin, float tMax) {
+    float t0 = tMin, t1 = tMax;
+    const float* o = &r.o.x; const float* id = &inv.x; const float* l = &lo.x; const float* h = &hi.x;
+    for (int k = 0; k < 3; k++) {
+        float a = (l[k] - o[k]) * id[k], b = (h[k] - o[k]) * id[k];
+        if (a > b) std::swap(a, b);
+        t0 = std::max(t0, a);
+        t1 = std::min(t1, b);
+        if (t0 > t1) return false;
+    }
+    return true;
+}
+
+// Moller-Trumbore, both faces
+static float intersectTri(const Ray& r, const PickTri& tri, float tMin) {
+    Vec3 e1 = tri.b - tri.a, e2 = tri.c - tri.a;
+    Vec3 p = crossp(r.d, e2);
+    float det = dotp(e1, p);
+    if (fabsf(det) < 1e-12f) return -1.0f;
+    float inv = 1.0f / det;
+    Vec3 s = r.o - tri.a;
+    float u = dotp(s, p) * inv;
+    if (u < 0 || u > 1) return -1.0f;
+    Vec3 q = crossp(s, e1);
+    float v = dotp(r.d, q) * inv;
+    if (v < 0 || u + v > 1) return -1.0f;
+    float t = dotp(e2, q) * inv;
+    return t >= tMin ? t : -1.0f;
+}
+
+// Nearest hit on shape mesh s (shape * lodLevels + level) at t >= tMin, or -1
+static float intersectMesh(const Ray& r, int s, float tMin) {
+    PickMesh& m = pickMeshes[s];
+    if (m.bvh.empty()) {
+        if (m.tris.empty()) collectPickTriangles(s);
+        if (m.tris.empty()) return -1.0f;
+        buildBvh(m, 0, static_cast<int>(m.tris.size()));
+    }
+    Vec3 inv(1.0f / r.d.x, 1.0f / r.d.y, 1.0f / r.d.z);
+    float best = 1e30f;
+    int stack[64], top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const BvhNode& node = m.bvh[stack[--top]];
+        if (!rayHitsBox(r, inv, node.lo, node.hi, tMin, best)) continue;
+        if (node.left < 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                float t = intersectTri(r, m.tris[i], tMin);
+                if (t > 0 && t < best) best = t;
+            }
+        }
+        else {
+            stack[top++] = node.left;
+            stack[top++] = node.right;
+        }
+    }
+    return best < 1e30f ? best : -1.0f;
+}
+
+// Nearest object under the pixel, or -1 for background; same ids as the color path.
+// A world-space bounding sphere test rejects most objects; the rest are intersected
+// at the LOD level they were last drawn with, so a ray pick sees the same pixels.
+static int pickRayAt(int mx, int my) {
+    Ray world = cameraRay(mx, my);
+    int picked = -1;
+    float best = 1e30f;
+    for (size_t i = 0; i < sceneObjects.size(); ++i) {
+        const SceneObject& o = sceneObjects[i];
+        float radius = shapeMeshes[o.shape * lodLevels].radius * o.scale;
+        Vec3 oc = world.o - o.pos;
+        float b = dotp(oc, world.d);
+        float c = dotp(oc, oc) - radius * radius;
+        if (b * b - c < 0 || -b - sqrtf(b * b - c) >= best) continue;
+
+        Ray r = toObjectSpace(world, o);
+        float t = intersectMesh(r, batchIndex(o), pickNear / o.scale);
+        if (t > 0 && t * o.scale < best) {
+            best = t * o.scale;
+            picked = static_cast<int>(i);
+        }
+    }
+    return picked;
+}
+
+// ---- GPU color picking -----------------------------------------------------
+
+static bool ensurePickTarget();
+
+// Blocking color pick: the whole pick pass into the offscreen pick target (the back
+// buffer when there is none), then an immediate read of the clicked pixel
+static int pickColorSyncAt(int mx, int my) {
+    const GLExt& gl = glExt;
+    bool offscreen = ensurePickTarget();
+    if (offscreen) {
+        gl.BindFramebuffer(GL_FRAMEBUFFER, pickTarget.fbo);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+    }
+    else {
+        glDrawBuffer(GL_BACK);
+        glReadBuffer(GL_BACK);
+    }
 
     int readY = winH - 1 - my;
     unsigned char pixel[3] = { 0,0,0 };
 
-    bool wasAA = useAA;
-    useAA = false;
-
     glViewport(0, 0, winW, winH);
     glClearColor(0, 0, 0, 1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -152,76 +1127,795 @@ static void pickAt(int mx, int my) {
 
     glReadPixels(mx, readY, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, pixel);
 
-    useAA = wasAA;
+    if (offscreen) {
+        gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+        glReadBuffer(GL_BACK);
+    }
 
     cout << "Picked color = ("
         << static_cast<int>(pixel[0]) << ", "
         << static_cast<int>(pixel[1]) << ", "
         << static_cast<int>(pixel[2]) << ")\n";
 
-    int picked = -1;
-    for (int id = 0; id < 3; ++id) {
-        if (pixel[0] == pickColorBytes[id][0] &&
-            pixel[1] == pickColorBytes[id][1] &&
-            pixel[2] == pickColorBytes[id][2]) {
-            picked = id;
-            break;
+    return decodePickColor(pixel);
+}
+
+// (Re)create the offscreen target at window size; false when FBOs/PBOs are unavailable
+static bool ensurePickTarget() {
+    const GLExt& gl = glExtInit();
+    if (!gl.fbo || !gl.pbo) return false;
+    if (pickTarget.fbo && pickTarget.w == winW && pickTarget.h == winH) return pickTarget.ok;
+
+    if (!pickTarget.fbo) {
+        gl.GenFramebuffers(1, &pickTarget.fbo);
+        gl.GenRenderbuffers(1, &pickTarget.color);
+        gl.GenRenderbuffers(1, &pickTarget.depth);
+        for (int k = 0; k < pickRingSize; k++) {
+            gl.GenBuffers(1, &pickRing[k].pbo);
+            gl.BindBuffer(GL_PIXEL_PACK_BUFFER, pickRing[k].pbo);
+            gl.BufferData(GL_PIXEL_PACK_BUFFER, 4, nullptr, GL_STREAM_READ);
+        }
+        gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    pickTarget.w = winW;
+    pickTarget.h = winH;
+    gl.BindRenderbuffer(GL_RENDERBUFFER, pickTarget.color);
+    gl.RenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, winW, winH);
+    gl.BindRenderbuffer(GL_RENDERBUFFER, pickTarget.depth);
+    gl.RenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, winW, winH);
+    gl.BindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    gl.BindFramebuffer(GL_FRAMEBUFFER, pickTarget.fbo);
+    gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, pickTarget.color);
+    gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, pickTarget.depth);
+    pickTarget.ok = gl.CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!pickTarget.ok) cout << "Pick framebuffer incomplete; using the blocking color pick\n";
+    return pickTarget.ok;
+}
+
+// Render the pick box offscreen and queue its center pixel for readback.
+// Returns false when no target or ring slot is available.
+static bool issuePickAsync(int mx, int my, std::chrono::steady_clock::time_point clicked) {
+    if (!ensurePickTarget()) return false;
+    PendingPick* slot = nullptr;
+    for (int k = 0; k < pickRingSize && !slot; k++)
+        if (!pickRing[k].busy) slot = &pickRing[k];
+    if (!slot) return false;
+
+    const GLExt& gl = glExt;
+    mx = max(0, min(winW - 1, mx));
+    int readY = max(0, min(winH - 1, winH - 1 - my));
+
+    gl.BindFramebuffer(GL_FRAMEBUFFER, pickTarget.fbo);
+    glViewport(0, 0, winW, winH);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(mx - pickBox / 2, readY - pickBox / 2, pickBox, pickBox);
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    setupCameraAndLight();
+    drawScene(true);
+
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    glReadPixels(mx, readY, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDisable(GL_SCISSOR_TEST);
+    gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    glReadBuffer(GL_BACK);
+
+    slot->fence = gl.sync ? gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : nullptr;
+    slot->frame = sched.frames;
+    slot->issued = clicked;
+    slot->busy = true;
+    glFlush(); // submit without waiting
+    return true;
+}
+
+static void applyPick(int picked);
+
+// Collect finished readbacks; called at the top of display(), before the frame
+// is begun so a recolor lands in this frame. Without fences a slot is read two
+// frames after issue, by which point the driver has retired it. Returns true
+// while readbacks are still in flight.
+static bool pollAsyncPicks() {
+    const GLExt& gl = glExt;
+    bool waiting = false;
+    for (int k = 0; k < pickRingSize; k++) {
+        PendingPick& p = pickRing[k];
+        if (!p.busy) continue;
+        bool ready;
+        if (p.fence) {
+            GLenum r = gl.ClientWaitSync(p.fence, 0, 0);
+            ready = (r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED);
         }
+        else ready = sched.frames >= p.frame + 2;
+        if (!ready) {
+            waiting = true;
+            continue;
+        }
+        if (p.fence) gl.DeleteSync(p.fence);
+        p.fence = nullptr;
+        p.busy = false;
+
+        unsigned char pixel[4] = { 0, 0, 0, 0 };
+        gl.BindBuffer(GL_PIXEL_PACK_BUFFER, p.pbo);
+        if (const unsigned char* mapped = static_cast<const unsigned char*>(gl.MapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY))) {
+            std::copy(mapped, mapped + 4, pixel);
+            gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        asyncResultMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - p.issued).count();
+        asyncFrames = static_cast<int>(sched.frames - p.frame);
+        applyPick(decodePickColor(pixel));
     }
+    return waiting;
+}
 
+static void applyPick(int picked) {
     if (picked >= 0) {
         // Èçìåíÿåì öâåò âûáðàííîãî îáúåêòà
-        objColor[picked][0] = static_cast<float>(rand()) / RAND_MAX;
-        objColor[picked][1] = static_cast<float>(rand()) / RAND_MAX;
-        objColor[picked][2] = static_cast<float>(rand()) / RAND_MAX;
+        float* color = sceneObjects[picked].color;
+        color[0] = static_cast<float>(rand()) / RAND_MAX;
+        color[1] = static_cast<float>(rand()) / RAND_MAX;
+        color[2] = static_cast<float>(rand()) / RAND_MAX;
+        updateBatchColor(picked);
 
         cout << "Picked object " << picked
             << " new color = ("
-            << objColor[picked][0] << ", "
-            << objColor[picked][1] << ", "
-            << objColor[picked][2] << ")\n";
+            << color[0] << ", "
+            << color[1] << ", "
+            << color[2] << ")\n";
 
-        glutPostRedisplay();
+        schedRequest(DIRTY_MATERIAL);
     }
     else {
         cout << "No object picked (background)\n";
     }
 }
 
-static void display() {
-    glViewport(0, 0, winW, winH);
+// (Re)create the frame target at window size
+static bool ensureIdBuffer() {
+    if (!useIdBuffer) return false;
+    if (idBuffer.fbo && idBuffer.w == winW && idBuffer.h == winH) return idBuffer.ok;
+    const GLExt& gl = glExt;
+    if (!idBuffer.fbo) {
+        gl.GenFramebuffers(1, &idBuffer.fbo);
+        glGenTextures(1, &idBuffer.color);
+        gl.GenRenderbuffers(1, &idBuffer.ids);
+        gl.GenRenderbuffers(1, &idBuffer.depth);
+        gl.GenBuffers(1, &idBuffer.pbo);
+    }
+    idBuffer.w = winW;
+    idBuffer.h = winH;
+    // shaded color is a texture so the FXAA pass can sample it
+    glBindTexture(GL_TEXTURE_2D, idBuffer.color);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, winW, winH, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GLuint buffers[2] = { idBuffer.ids, idBuffer.depth };
+    GLenum formats[2] = { GL_RGBA8, GL_DEPTH_COMPONENT24 };
+    GLenum points[2] = { GL_COLOR_ATTACHMENT1, GL_DEPTH_ATTACHMENT };
+    gl.BindFramebuffer(GL_FRAMEBUFFER, idBuffer.fbo);
+    gl.FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, idBuffer.color, 0);
+    for (int k = 0; k < 2; k++) {
+        gl.BindRenderbuffer(GL_RENDERBUFFER, buffers[k]);
+        gl.RenderbufferStorage(GL_RENDERBUFFER, formats[k], winW, winH);
+        gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, points[k], GL_RENDERBUFFER, buffers[k]);
+    }
+    gl.BindRenderbuffer(GL_RENDERBUFFER, 0);
+    idBuffer.ok = gl.CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, idBuffer.pbo);
+    gl.BufferData(GL_PIXEL_PACK_BUFFER, static_cast<ptrdiff_t>(winW) * winH * 4, nullptr, GL_STREAM_READ);
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    idBuffer.version++;
+    idBuffer.readVersion = 0;
+    if (!idBuffer.ok) {
+        cout << "Id framebuffer incomplete; picks render their own pass\n";
+        useIdBuffer = false;
+        if (pickMode == PICK_ID_BUFFER) pickMode = PICK_RAY;
+    }
+    return idBuffer.ok;
+}
+
+// Queue the id attachment for readback; call with the frame target bound
+static void queueIdReadback() {
+    const GLExt& gl = glExt;
+    if (idBuffer.fence) gl.DeleteSync(idBuffer.fence);
+    glReadBuffer(GL_COLOR_ATTACHMENT1);
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, idBuffer.pbo);
+    glReadPixels(0, 0, idBuffer.w, idBuffer.h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    idBuffer.fence = gl.sync ? gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : nullptr;
+    idBuffer.readVersion = idBuffer.version;
+}
+
+// Make the cpu copy current. With wait = false, returns false instead of stalling
+// while the readback is still on the GPU.
+static bool idBufferCurrent(bool wait) {
+    if (!useIdBuffer) return false;
+    if (idBuffer.cpuVersion == idBuffer.version) return true;
+    if (idBuffer.readVersion != idBuffer.version) return false; // not rendered yet
+    const GLExt& gl = glExt;
+    if (idBuffer.fence) {
+        if (!wait) {
+            GLenum r = gl.ClientWaitSync(idBuffer.fence, 0, 0);
+            if (r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED) return false;
+        }
+        gl.DeleteSync(idBuffer.fence);
+        idBuffer.fence = nullptr;
+    }
+    idBuffer.cpu.resize(static_cast<size_t>(idBuffer.w) * idBuffer.h * 4);
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, idBuffer.pbo);
+    if (const unsigned char* mapped = static_cast<const unsigned char*>(gl.MapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY))) {
+        std::copy(mapped, mapped + idBuffer.cpu.size(), idBuffer.cpu.begin());
+        gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    idBuffer.cpuVersion = idBuffer.version;
+    idBuffer.readbacks++;
+    return true;
+}
+
+// Object at window pixel (mx, my) from the current frame; false if the id buffer can't answer
+static bool idBufferAt(int mx, int my, int& id, bool wait = true) {
+    if (!idBufferCurrent(wait)) return false;
+    idBuffer.queries++;
+    if (mx < 0 || my < 0 || mx >= idBuffer.w || my >= idBuffer.h) {
+        id = -1;
+        return true;
+    }
+    id = decodePickColor(&idBuffer.cpu[(static_cast<size_t>(idBuffer.h - 1 - my) * idBuffer.w + mx) * 4]);
+    return true;
+}
+
+// Pixel count per object inside the window rectangle [x0, x1] x [y0, y1]; background is not counted
+static bool idBufferHistogram(int x0, int y0, int x1, int y1, map<int, int>& hist) {
+    if (!idBufferCurrent(true)) return false;
+    idBuffer.queries++;
+    x0 = max(0, x0); y0 = max(0, y0);
+    x1 = min(idBuffer.w - 1, x1); y1 = min(idBuffer.h - 1, y1);
+    for (int y = y0; y <= y1; y++) {
+        const unsigned char* row = &idBuffer.cpu[static_cast<size_t>(idBuffer.h - 1 - y) * idBuffer.w * 4];
+        for (int x = x0; x <= x1; x++) {
+            int id = decodePickColor(row + x * 4);
+            if (id >= 0) hist[id]++;
+        }
+    }
+    return true;
+}
+
+// Hover picking: the id buffer when it can answer, the CPU ray otherwise.
+// Returns false while the id readback is still in flight.
+static bool updateHover(bool wait) {
+    if (hoverX < 0) return true;
+    int id;
+    if (!useIdBuffer) id = pickRayAt(hoverX, hoverY);
+    else if (!idBufferAt(hoverX, hoverY, id, wait)) return false;
+    if (id != hoveredId) {
+        hoveredId = id;
+        schedRequest(DIRTY_MATERIAL);
+    }
+    return true;
+}
+
+// ---- Drag selection -----------------------------------------------------------
 
-    if (useAA) {
-        glEnable(GL_LINE_SMOOTH);
-        glEnable(GL_POLYGON_SMOOTH);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+static void dragBounds(int& x0, int& y0, int& x1, int& y1) {
+    x0 = x1 = dragPath[0].first;
+    y0 = y1 = dragPath[0].second;
+    for (size_t k = 1; k < dragPath.size(); k++) {
+        x0 = min(x0, dragPath[k].first); x1 = max(x1, dragPath[k].first);
+        y0 = min(y0, dragPath[k].second); y1 = max(y1, dragPath[k].second);
+    }
+    x0 = max(0, x0); y0 = max(0, y0);
+    x1 = min(winW - 1, x1); y1 = min(winH - 1, y1);
+}
+
+// Even-odd test, matching the stencil fill used for the queries
+static bool insideLasso(float x, float y) {
+    bool inside = false;
+    for (size_t i = 0, j = dragPath.size() - 1; i < dragPath.size(); j = i++) {
+        float xi = static_cast<float>(dragPath[i].first), yi = static_cast<float>(dragPath[i].second);
+        float xj = static_cast<float>(dragPath[j].first), yj = static_cast<float>(dragPath[j].second);
+        if ((yi > y) != (yj > y) && x < (xj - xi) * (y - yi) / (yj - yi) + xi) inside = !inside;
+    }
+    return inside;
+}
+
+static float distanceToLasso(float x, float y) {
+    float best = 1e30f;
+    for (size_t i = 0, j = dragPath.size() - 1; i < dragPath.size(); j = i++) {
+        float ax = static_cast<float>(dragPath[j].first), ay = static_cast<float>(dragPath[j].second);
+        float dx = dragPath[i].first - ax, dy = dragPath[i].second - ay;
+        float len2 = dx * dx + dy * dy;
+        float t = len2 > 0 ? max(0.0f, min(1.0f, ((x - ax) * dx + (y - ay) * dy) / len2)) : 0.0f;
+        float ex = ax + t * dx - x, ey = ay + t * dy - y;
+        best = min(best, ex * ex + ey * ey);
+    }
+    return sqrtf(best);
+}
+
+// Objects whose bounding sphere can touch the drag region. The region's bounding
+// rectangle defines a sub-frustum: in the camera frame a point at depth a lies
+// inside when xl <= right / a <= xr and yb <= up / a <= yt. A lasso additionally
+// rejects spheres whose projection stays clear of the polygon.
+static void selectCandidates(vector<int>& out) {
+    CameraFrame c = cameraFrame();
+    int x0, y0, x1, y1;
+    dragBounds(x0, y0, x1, y1);
+    float xl = (2.0f * x0 / winW - 1.0f) * c.tanHalfX, xr = (2.0f * (x1 + 1) / winW - 1.0f) * c.tanHalfX;
+    float yt = (1.0f - 2.0f * y0 / winH) * c.tanHalfY, yb = (1.0f - 2.0f * (y1 + 1) / winH) * c.tanHalfY;
+    float nl = 1.0f / sqrtf(1 + xl * xl), nr = 1.0f / sqrtf(1 + xr * xr);
+    float nt = 1.0f / sqrtf(1 + yt * yt), nb = 1.0f / sqrtf(1 + yb * yb);
+    float pxPerUnit = 0.5f * winH / c.tanHalfY;
+    bool lasso = selectTool == SELECT_LASSO && dragPath.size() >= 3;
+
+    for (size_t i = 0; i < sceneObjects.size(); i++) {
+        const SceneObject& o = sceneObjects[i];
+        float r = shapeMeshes[o.shape * lodLevels].radius * o.scale;
+        Vec3 v = o.pos - c.eye;
+        float a = dotp(v, c.f), b = dotp(v, c.s), up = dotp(v, c.u);
+        if (a < pickNear - r || a > 100.0f + r) continue;
+        if ((b - xl * a) * nl < -r || (xr * a - b) * nr < -r) continue;
+        if ((up - yb * a) * nb < -r || (yt * a - up) * nt < -r) continue;
+        if (lasso && a > r) {
+            float sx = (b / a / c.tanHalfX + 1.0f) * 0.5f * winW;
+            float sy = (1.0f - up / a / c.tanHalfY) * 0.5f * winH;
+            // projected radius, widened for the off-axis stretch of the sphere's ellipse
+            float rp = pxPerUnit * r / sqrtf(a * a - r * r) * dotp(v, v) / (a * a);
+            if (!insideLasso(sx, sy) && distanceToLasso(sx, sy) > rp) continue;
+        }
+        out.push_back(static_cast<int>(i));
+    }
+}
+
+static bool ensureSelectTarget() {
+    const GLExt& gl = glExtInit();
+    if (!gl.fbo || !gl.query) return false;
+    if (selectTarget.fbo && selectTarget.w == winW && selectTarget.h == winH) return selectTarget.ok;
+    if (!selectTarget.fbo) {
+        gl.GenFramebuffers(1, &selectTarget.fbo);
+        gl.GenRenderbuffers(1, &selectTarget.color);
+        gl.GenRenderbuffers(1, &selectTarget.depthStencil);
+    }
+    selectTarget.w = winW;
+    selectTarget.h = winH;
+    gl.BindRenderbuffer(GL_RENDERBUFFER, selectTarget.color);
+    gl.RenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, winW, winH);
+    gl.BindRenderbuffer(GL_RENDERBUFFER, selectTarget.depthStencil);
+    gl.RenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, winW, winH);
+    gl.BindRenderbuffer(GL_RENDERBUFFER, 0);
+    gl.BindFramebuffer(GL_FRAMEBUFFER, selectTarget.fbo);
+    gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, selectTarget.color);
+    gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, selectTarget.depthStencil);
+    gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, selectTarget.depthStencil);
+    selectTarget.ok = gl.CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!selectTarget.ok) cout << "Selection framebuffer incomplete; drag selection uses bounding spheres only\n";
+    return selectTarget.ok;
+}
+
+// Draw single objects with the same path and vertex program as drawScene(true),
+// so their depth matches the prepass exactly
+static void beginPickObjects() {
+    prepareBatches();
+    glDisable(GL_LIGHTING);
+    if (instanceProgram) {
+        const GLExt& gl = glExt;
+        gl.UseProgram(instanceProgram);
+        gl.Uniform1i(instancePickLoc, 1);
+        for (GLuint a = 0; a < 8; a++) gl.EnableVertexAttribArray(a);
+        for (GLuint a = 2; a < 8; a++) gl.VertexAttribDivisor(a, 1);
     }
     else {
-        glDisable(GL_LINE_SMOOTH);
-        glDisable(GL_POLYGON_SMOOTH);
-        glDisable(GL_BLEND);
+        glEnableClientState(GL_VERTEX_ARRAY);
     }
+}
 
-    glClearColor(0.12f, 0.12f, 0.12f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+static void drawPickObject(int index) {
+    const SceneObject& o = sceneObjects[index];
+    int s = batchIndex(o);
+    GLsizei count = static_cast<GLsizei>(shapeMeshes[s].idx.size());
+    if (instanceProgram) {
+        const void* indices = bindShapeMesh(s, true);
+        bindShapeInstances(s, o.slot);
+        glExt.DrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, indices, 1);
+    }
+    else {
+        const void* indices = bindShapeMesh(s, false);
+        glPushMatrix();
+        glMultMatrixf(&shapeBatches[s].inst[o.slot * instFloats]);
+        glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, indices);
+        glPopMatrix();
+    }
+}
+
+static void endPickObjects() {
+    unbindShapeBuffers();
+    if (instanceProgram) {
+        const GLExt& gl = glExt;
+        for (GLuint a = 2; a < 8; a++) gl.VertexAttribDivisor(a, 0);
+        for (GLuint a = 0; a < 8; a++) gl.DisableVertexAttribArray(a);
+        gl.UseProgram(0);
+    }
+    else {
+        glDisableClientState(GL_VERTEX_ARRAY);
+    }
+}
+
+// One occlusion query per candidate, all issued before any result is read so the
+// whole drag costs a single wait on the GPU
+static void queryVisibleCandidates(const vector<int>& candidates, vector<int>& hits) {
+    const GLExt& gl = glExt;
+    int x0, y0, x1, y1;
+    dragBounds(x0, y0, x1, y1);
+    if (selectQueries.size() < candidates.size()) {
+        size_t have = selectQueries.size();
+        selectQueries.resize(candidates.size());
+        gl.GenQueries(static_cast<GLsizei>(candidates.size() - have), &selectQueries[have]);
+    }
+
+    gl.BindFramebuffer(GL_FRAMEBUFFER, selectTarget.fbo);
+    glViewport(0, 0, winW, winH);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x0, winH - 1 - y1, x1 - x0 + 1, y1 - y0 + 1);
+    glClearStencil(0);
+    glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    if (selectTool == SELECT_LASSO && dragPath.size() >= 3) {
+        // even-odd fill of the lasso into the stencil; queries then count only pixels inside it
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(0, winW, 0, winH, -1, 1);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 0, 1);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+        glBegin(GL_TRIANGLE_FAN);
+        for (size_t k = 0; k < dragPath.size(); k++)
+            glVertex2f(dragPath[k].first + 0.5f, winH - dragPath[k].second - 0.5f);
+        glEnd();
+        glEnable(GL_DEPTH_TEST);
+        glStencilFunc(GL_EQUAL, 1, 1);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    }
 
     setupCameraAndLight();
+    if (excludeOccluded) drawScene(true); // depth of everything, occluders included
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    beginPickObjects();
+    for (size_t k = 0; k < candidates.size(); k++) {
+        gl.BeginQuery(GL_SAMPLES_PASSED, selectQueries[k]);
+        drawPickObject(candidates[k]);
+        gl.EndQuery(GL_SAMPLES_PASSED);
+    }
+    endPickObjects();
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_SCISSOR_TEST);
+    gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    for (size_t k = 0; k < candidates.size(); k++) {
+        GLuint samples = 0;
+        gl.GetQueryObjectuiv(selectQueries[k], GL_QUERY_RESULT, &samples);
+        if (samples > 0) hits.push_back(candidates[k]);
+    }
+}
+
+static void runSelection() {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point t0 = Clock::now();
+    vector<int> candidates, hits;
+    selectCandidates(candidates);
+    Clock::time_point t1 = Clock::now();
+    bool queried = !candidates.empty() && ensureSelectTarget();
+    if (queried) queryVisibleCandidates(candidates, hits);
+    else hits = candidates;
+    Clock::time_point t2 = Clock::now();
+
+    if (!dragAdd) {
+        for (size_t i = 0; i < sceneObjects.size(); i++) {
+            if (!sceneObjects[i].selected) continue;
+            sceneObjects[i].selected = false;
+            updateBatchSelection(static_cast<int>(i));
+        }
+    }
+    for (size_t k = 0; k < hits.size(); k++) {
+        sceneObjects[hits[k]].selected = true;
+        updateBatchSelection(hits[k]);
+    }
+    selectedCount = 0;
+    for (size_t i = 0; i < sceneObjects.size(); i++) selectedCount += sceneObjects[i].selected ? 1 : 0;
+
+    char buf[160];
+    sprintf_s(buf, sizeof(buf), "%zu of %zu candidates %s (cull %.0f us, queries %.0f us)", hits.size(), candidates.size(),
+        queried ? (excludeOccluded ? "visible" : "covering") : "kept, no queries",
+        std::chrono::duration<double, std::micro>(t1 - t0).count(),
+        std::chrono::duration<double, std::micro>(t2 - t1).count());
+    selectStats = buf;
+    cout << "Selected " << selectedCount << " objects: " << selectStats << "\n";
+    schedRequest(DIRTY_MATERIAL | DIRTY_HUD);
+}
+
+static void pickAt(int mx, int my) {
+    typedef std::chrono::steady_clock Clock;
+    if (pickMode == PICK_ID_BUFFER) {
+        Clock::time_point t0 = Clock::now();
+        int id;
+        if (idBufferAt(mx, my, id)) {
+            idQueryUs = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+            schedRequest(DIRTY_HUD);
+            applyPick(id);
+            return;
+        }
+        // no id buffer for this frame yet: the CPU ray cast answers without a render
+        applyPick(pickRayAt(mx, my));
+        return;
+    }
+    if (pickMode == PICK_COLOR) {
+        Clock::time_point t0 = Clock::now();
+        if (issuePickAsync(mx, my, t0)) {
+            asyncIssueUs = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+            schedRequest(DIRTY_HUD);
+            return;
+        }
+        // no offscreen target or every slot still in flight: fall through to the blocking pick
+    }
+
+    int colorId = -1, rayId = -1;
+    double colorUs = 0, rayUs = 0;
+    if (pickMode != PICK_RAY) {
+        Clock::time_point t0 = Clock::now();
+        colorId = pickColorSyncAt(mx, my);
+        colorUs = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+        syncPickUs = colorUs;
+        // without a pick target the pass left the back buffer in pick colors
+        schedRequest(pickTarget.ok ? DIRTY_HUD : DIRTY_ALL);
+    }
+    if (pickMode == PICK_RAY || pickMode == PICK_COMPARE) {
+        Clock::time_point t0 = Clock::now();
+        rayId = pickRayAt(mx, my);
+        rayUs = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+    }
+    if (pickMode == PICK_COMPARE) {
+        cout << "color pick: " << colorId << " (" << colorUs << " us)   ray pick: " << rayId
+            << " (" << rayUs << " us)   " << (colorId == rayId ? "MATCH" : "MISMATCH") << "\n";
+    }
+    applyPick((pickMode == PICK_COLOR || pickMode == PICK_COLOR_SYNC) ? colorId : rayId);
+}
 
+// ---- Anti-aliasing ----------------------------------------------------------
+
+static int aaSamples(AAMode mode) {
+    return mode == AA_MSAA2 ? 2 : mode == AA_MSAA4 ? 4 : mode == AA_MSAA8 ? 8 : 0;
+}
+
+static bool aaModeAvailable(AAMode mode) {
+    if (mode == AA_OFF) return true;
+    if (mode == AA_FXAA) return fxaaProgram != 0;
+    return glExt.msaa && aaSamples(mode) <= maxSamples;
+}
+
+static const char* aaModeName(AAMode mode) {
+    static const char* names[] = { "off", "MSAA 2x", "MSAA 4x", "MSAA 8x", "FXAA" };
+    return names[mode];
+}
+
+// Offscreen scene target for the current mode: multisampled color and depth for
+// MSAA, a color texture for FXAA when the id buffer is not there to provide one
+static bool ensureAATarget() {
+    if (aaTarget.fbo && aaTarget.w == winW && aaTarget.h == winH && aaTarget.mode == aaMode) return aaTarget.ok;
+    const GLExt& gl = glExt;
+    if (!aaTarget.fbo) {
+        gl.GenFramebuffers(1, &aaTarget.fbo);
+        gl.GenRenderbuffers(1, &aaTarget.color);
+        gl.GenRenderbuffers(1, &aaTarget.depth);
+        glGenTextures(1, &aaTarget.texture);
+    }
+    aaTarget.w = winW;
+    aaTarget.h = winH;
+    aaTarget.mode = aaMode;
+    int samples = aaSamples(aaMode);
+    gl.BindFramebuffer(GL_FRAMEBUFFER, aaTarget.fbo);
+    if (samples > 0) {
+        gl.BindRenderbuffer(GL_RENDERBUFFER, aaTarget.color);
+        gl.RenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, winW, winH);
+        gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, aaTarget.color);
+        gl.BindRenderbuffer(GL_RENDERBUFFER, aaTarget.depth);
+        gl.RenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, winW, winH);
+    }
+    else {
+        glBindTexture(GL_TEXTURE_2D, aaTarget.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, winW, winH, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        gl.FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, aaTarget.texture, 0);
+        gl.BindRenderbuffer(GL_RENDERBUFFER, aaTarget.depth);
+        gl.RenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, winW, winH);
+    }
+    gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, aaTarget.depth);
+    gl.BindRenderbuffer(GL_RENDERBUFFER, 0);
+    aaTarget.ok = gl.CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!aaTarget.ok) cout << aaModeName(aaMode) << " framebuffer incomplete; drawing without anti-aliasing\n";
+    return aaTarget.ok;
+}
+
+// Single-pass FXAA after Lottes' console variant, with the local-contrast early out
+// of FXAA 3.11: estimate the edge direction from the luma of the four diagonal neighbours, blur
+// along it with two or four bilinear taps, and keep the wider blur only while it
+// stays inside the local luma range
+static const char* fxaaVS =
+    "#version 120\n"
+    "void main() {\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_Position = gl_Vertex;\n"
+    "}\n";
+
+static const char* fxaaFS =
+    "#version 120\n"
+    "uniform sampler2D source;\n"
+    "uniform vec2 texel;\n"
+    "const vec3 toLuma = vec3(0.299, 0.587, 0.114);\n"
+    "void main() {\n"
+    "    vec2 uv = gl_TexCoord[0].xy;\n"
+    "    float nw = dot(texture2D(source, uv + vec2(-1.0, -1.0) * texel).rgb, toLuma);\n"
+    "    float ne = dot(texture2D(source, uv + vec2(1.0, -1.0) * texel).rgb, toLuma);\n"
+    "    float sw = dot(texture2D(source, uv + vec2(-1.0, 1.0) * texel).rgb, toLuma);\n"
+    "    float se = dot(texture2D(source, uv + vec2(1.0, 1.0) * texel).rgb, toLuma);\n"
+    "    vec3 center = texture2D(source, uv).rgb;\n"
+    "    float m = dot(center, toLuma);\n"
+    "    float lo = min(m, min(min(nw, ne), min(sw, se)));\n"
+    "    float hi = max(m, max(max(nw, ne), max(sw, se)));\n"
+    "    if (hi - lo < max(0.0312, hi * 0.125)) { gl_FragColor = vec4(center, 1.0); return; }\n"
+    "    vec2 dir = vec2(-((nw + ne) - (sw + se)), (nw + sw) - (ne + se));\n"
+    "    float reduce = max((nw + ne + sw + se) * 0.03125, 1.0 / 128.0);\n"
+    "    dir = clamp(dir / (min(abs(dir.x), abs(dir.y)) + reduce), -8.0, 8.0) * texel;\n"
+    "    vec3 a = 0.5 * (texture2D(source, uv - dir / 6.0).rgb + texture2D(source, uv + dir / 6.0).rgb);\n"
+    "    vec3 b = 0.5 * a + 0.25 * (texture2D(source, uv - dir * 0.5).rgb + texture2D(source, uv + dir * 0.5).rgb);\n"
+    "    float lb = dot(b, toLuma);\n"
+    "    gl_FragColor = vec4((lb < lo || lb > hi) ? a : b, 1.0);\n"
+    "}\n";
+
+// Filter `texture` onto the bound framebuffer with a full-screen quad
+static void drawFxaa(GLuint texture) {
+    const GLExt& gl = glExt;
+    glMatrixMode(GL_PROJECTION);
     glPushMatrix();
-    glTranslatef(camCenterX, camCenterY, camCenterZ);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glDisable(GL_DEPTH_TEST);
     glDisable(GL_LIGHTING);
-    glLineWidth(2.0f);
-    glBegin(GL_LINES);
-    glColor3f(1, 0, 0); glVertex3f(0, 0, 0); glVertex3f(0.8f, 0, 0);
-    glColor3f(0, 1, 0); glVertex3f(0, 0, 0); glVertex3f(0, 0.8f, 0);
-    glColor3f(0, 0, 1); glVertex3f(0, 0, 0); glVertex3f(0, 0, 0.8f);
+    gl.UseProgram(fxaaProgram);
+    gl.Uniform2f(fxaaTexelLoc, 1.0f / winW, 1.0f / winH);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0); glVertex2f(-1, -1);
+    glTexCoord2f(1, 0); glVertex2f(1, -1);
+    glTexCoord2f(1, 1); glVertex2f(1, 1);
+    glTexCoord2f(0, 1); glVertex2f(-1, 1);
     glEnd();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    gl.UseProgram(0);
+    glEnable(GL_DEPTH_TEST);
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
     glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
 
-    drawScene(false);
+static void initAA() {
+    const GLExt& gl = glExt;
+    if (gl.msaa) glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    if (gl.fbo && gl.glsl) {
+        fxaaProgram = glExtBuildProgram(fxaaVS, fxaaFS, nullptr);
+        if (fxaaProgram) fxaaTexelLoc = gl.GetUniformLocation(fxaaProgram, "texel");
+    }
+    if (gl.timer) gl.GenQueries(2, aaTimer.queries);
+    aaMode = aaModeAvailable(AA_MSAA4) ? AA_MSAA4 : aaModeAvailable(AA_FXAA) ? AA_FXAA : AA_OFF;
+    cout << "Anti-aliasing: " << aaModeName(aaMode) << " (MSAA up to " << maxSamples << "x"
+        << (fxaaProgram ? ", FXAA available" : "") << ")\n";
+}
+
+// Pick each object's level from its projected bounding radius in pixels, keeping the
+// current level until the radius clears a cut by the hysteresis margin. Batches are
+// rebuilt only when some object actually changed level.
+static void updateLods() {
+    CameraFrame c = cameraFrame();
+    float pxPerUnit = 0.5f * winH / c.tanHalfY;
+    bool changed = false;
+    int counts[lodLevels] = { 0, 0, 0, 0 };
+    double triangles = 0.0;
+    for (size_t i = 0; i < sceneObjects.size(); i++) {
+        SceneObject& o = sceneObjects[i];
+        int lod = 0;
+        if (useLod) {
+            float r = shapeMeshes[o.shape * lodLevels].radius * o.scale;
+            float depth = dotp(o.pos - c.eye, c.f);
+            float px = depth > r ? r * pxPerUnit / depth : 1e30f;
+            while (lod < lodLevels - 1 && px < lodCut[lod]) lod++;
+            if (lod > o.lod && px > lodCut[o.lod] * (1.0f - lodHysteresis)) lod = o.lod;
+            if (lod < o.lod && px < lodCut[o.lod - 1] * (1.0f + lodHysteresis)) lod = o.lod;
+        }
+        if (lod != o.lod) {
+            o.lod = lod;
+            changed = true;
+        }
+        counts[lod]++;
+        triangles += shapeMeshes[batchIndex(o)].idx.size() / 3;
+    }
+    if (changed) sceneDirty = true;
+    for (int l = 0; l < lodLevels; l++) lodCounts[l] = counts[l];
+    lodTriangles = triangles;
+}
+
+// Frames per second of the scene on each draw path: the original glutSolid* call per
+// object, then the cached meshes from client arrays and from VBOs. Every path renders
+// the same camera sweep into the back buffer and finishes each frame before the next.
+static void runDrawBenchmark() {
+    typedef std::chrono::steady_clock Clock;
+    static const char* names[] = { "glutSolid* per object", "cached meshes, client arrays", "cached meshes, VBOs" };
+    DrawPath saved = drawPath;
+    float savedAz = camAz;
+    int savedHover = hoveredId;
+    hoveredId = -1;
+    int first = headless.active ? DRAW_CLIENT_ARRAYS : DRAW_GLUT; // glutSolid* needs glutInit
+    int last = glExt.vbo ? DRAW_VBO : DRAW_CLIENT_ARRAYS;
+    const GLExt& gl = glExt;
+    if (gl.fbo) gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, winW, winH);
+    cout << "Benchmark: " << sceneObjects.size() << " objects, " << winW << "x" << winH
+        << (instanceProgram ? ", instanced" : ", per-object draws") << ", LOD " << (useLod ? "on" : "off")
+        << " (glutSolid* always full detail)\n";
+    for (int p = first; p <= last; p++) {
+        drawPath = static_cast<DrawPath>(p);
+        int frames = -1; // one warm-up frame uploads whatever the path needs
+        double elapsed = 0.0;
+        Clock::time_point t0 = Clock::now();
+        while (frames < 3 || (elapsed < 2.0 && frames < 300)) {
+            if (frames == 0) t0 = Clock::now();
+            camAz = savedAz + 1.5f * max(frames, 0);
+            updateLods();
+            glClearColor(0.12f, 0.12f, 0.12f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            setupCameraAndLight();
+            drawScene(false);
+            glFinish();
+            frames++;
+            if (frames > 0) elapsed = std::chrono::duration<double>(Clock::now() - t0).count();
+        }
+        benchFps[p] = frames / elapsed;
+        char buf[128];
+        sprintf_s(buf, sizeof(buf), "  %-30s %8.1f fps  (%.2f ms/frame, %d frames)", names[p], benchFps[p], 1000.0 * elapsed / frames, frames);
+        cout << buf << "\n";
+    }
+    drawPath = saved;
+    camAz = savedAz;
+    hoveredId = savedHover;
+    schedRequest(DIRTY_ALL);
+}
 
-    // HUD
+// Status lines and the drag outline, in window coordinates
+static void drawHud() {
     glMatrixMode(GL_PROJECTION);
     glPushMatrix();
     glLoadIdentity();
@@ -232,29 +1926,238 @@ static void display() {
     glDisable(GL_LIGHTING);
     glColor3f(1, 1, 1);
 
-    string hud = "AA: (a) " + string(useAA ? "ON" : "OFF") +
+    static const char* pickNames[] = { "color", "color (blocking)", "ray", "compare", "id buffer" };
+    char buf[192];
+    string aaCost = "";
+    if (aaSceneMs >= 0) {
+        sprintf_s(buf, sizeof(buf), " (GPU: scene %.2f ms + %s %.2f ms)", aaSceneMs, aaPostName, aaPostMs);
+        aaCost = buf;
+    }
+    string hud = "AA: (a) " + string(aaModeName(aaMode)) + aaCost +
+        "   Pick: (m) " + pickNames[pickMode] +
         "     Click to pick object     Camera: arrow keys (rotate), w/s zoom, r reset";
     glRasterPos2i(8, winH - 18);
     for (char c : hud) {
         glutBitmapCharacter(GLUT_BITMAP_8_BY_13, c);
     }
 
+    string sync = "-", async = "-";
+    if (syncPickUs >= 0) {
+        sprintf_s(buf, sizeof(buf), "%.0f us", syncPickUs);
+        sync = buf;
+    }
+    if (asyncIssueUs >= 0) {
+        sprintf_s(buf, sizeof(buf), "%.0f us to issue", asyncIssueUs);
+        async = buf;
+        if (asyncResultMs >= 0) {
+            sprintf_s(buf, sizeof(buf), ", result after %.2f ms / %d frame%s", asyncResultMs, asyncFrames, asyncFrames == 1 ? "" : "s");
+            async += buf;
+        }
+    }
+    string latency = "Pick latency   blocking read: " + sync + "   offscreen async: " + async +
+        "     Objects: (n) " + to_string(sceneObjects.size()) + (instanceProgram ? ", instanced" : ", per-object draws");
+    glRasterPos2i(8, winH - 34);
+    for (char c : latency) {
+        glutBitmapCharacter(GLUT_BITMAP_8_BY_13, c);
+    }
+
+    if (useIdBuffer) {
+        sprintf_s(buf, sizeof(buf), "Id buffer   last click: %s   %zu queries from %zu readbacks   hover: %d   (h: histogram around cursor)",
+            idQueryUs >= 0 ? (to_string(static_cast<int>(idQueryUs + 0.5)) + " us").c_str() : "-",
+            idBuffer.queries, idBuffer.readbacks, hoveredId);
+        glRasterPos2i(8, winH - 50);
+        for (const char* c = buf; *c; c++) {
+            glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+        }
+    }
+
+    string bench = "Draw: " + string(drawPath == DRAW_VBO ? "VBO" : "client array") + " meshes   LOD (d): ";
+    if (useLod) {
+        sprintf_s(buf, sizeof(buf), "%d/%d/%d/%d objects", lodCounts[0], lodCounts[1], lodCounts[2], lodCounts[3]);
+        bench += buf;
+    }
+    else bench += "off";
+    sprintf_s(buf, sizeof(buf), ", %.2fM tris   benchmark (b):", lodTriangles / 1e6);
+    bench += buf;
+    if (benchFps[DRAW_GLUT] < 0) bench += " not run";
+    static const char* benchNames[] = { "glutSolid", "arrays", "VBO" };
+    for (int p = DRAW_GLUT; p <= DRAW_VBO; p++) {
+        if (benchFps[p] < 0) continue;
+        sprintf_s(buf, sizeof(buf), "  %s %.1f fps", benchNames[p], benchFps[p]);
+        bench += buf;
+    }
+    glRasterPos2i(8, 10);
+    for (char c : bench) {
+        glutBitmapCharacter(GLUT_BITMAP_8_BY_13, c);
+    }
+
+    string select = "Select: drag (l) " + string(selectTool == SELECT_LASSO ? "lasso" : "rect") +
+        "   occluded (o) " + (excludeOccluded ? "excluded" : "included") +
+        "   shift adds, c clears   selected " + to_string(selectedCount) + "   last: " + selectStats;
+    glRasterPos2i(8, winH - (useIdBuffer ? 66 : 50));
+    for (char c : select) {
+        glutBitmapCharacter(GLUT_BITMAP_8_BY_13, c);
+    }
+
+    if (dragging && !dragPath.empty()) {
+        glDisable(GL_DEPTH_TEST);
+        glColor3f(1.0f, 0.85f, 0.2f);
+        glLineWidth(1.0f);
+        glBegin(GL_LINE_LOOP);
+        if (selectTool == SELECT_LASSO) {
+            for (size_t k = 0; k < dragPath.size(); k++)
+                glVertex2f(dragPath[k].first + 0.5f, winH - dragPath[k].second - 0.5f);
+        }
+        else {
+            float ax = dragPath.front().first + 0.5f, ay = winH - dragPath.front().second - 0.5f;
+            float bx = dragPath.back().first + 0.5f, by = winH - dragPath.back().second - 0.5f;
+            glVertex2f(ax, ay); glVertex2f(bx, ay); glVertex2f(bx, by); glVertex2f(ax, by);
+        }
+        glEnd();
+        glEnable(GL_DEPTH_TEST);
+    }
+
     glPopMatrix();
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
     glMatrixMode(GL_MODELVIEW);
+}
+
+static void display() {
+    if (benchOnStart) {
+        runDrawBenchmark();
+        exit(0);
+    }
+    bool picksInFlight = pollAsyncPicks();
+    unsigned dirty = schedBeginFrame();
+    if (picksInFlight) schedRequest(DIRTY_HUD); // poll again next frame
+    if (dirty & (DIRTY_CAMERA | DIRTY_MESH)) updateLods();
+
+    // Ids change only with the camera or scene. Without MSAA they are written by the
+    // shading pass itself (second attachment); with it they get their own pick pass.
+    bool toIdBuffer = ensureIdBuffer();
+    bool msaa = aaSamples(aaMode) > 0 && ensureAATarget();
+    bool fxaa = aaMode == AA_FXAA && (toIdBuffer || ensureAATarget());
+    bool mrt = toIdBuffer && !msaa;
+    const GLExt& gl = glExt;
+    if (toIdBuffer && (dirty & (DIRTY_CAMERA | DIRTY_MESH))) idBuffer.version++;
+    glViewport(0, 0, winW, winH);
 
-    glutSwapBuffers();
+    if (toIdBuffer && msaa && idBuffer.readVersion != idBuffer.version) {
+        static const GLenum idsOnly[2] = { GL_NONE, GL_COLOR_ATTACHMENT1 };
+        gl.BindFramebuffer(GL_FRAMEBUFFER, idBuffer.fbo);
+        gl.DrawBuffers(2, idsOnly);
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        setupCameraAndLight();
+        drawScene(true);
+        queueIdReadback();
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    }
+
+    // timings of the previous measured frame; a frame that only polls for them measures nothing
+    bool timingPoll = aaTimer.poll;
+    aaTimer.poll = false;
+    if (aaTimer.pending) {
+        GLuint ready = 0;
+        gl.GetQueryObjectuiv(aaTimer.queries[1], GL_QUERY_RESULT_AVAILABLE, &ready);
+        if (ready) {
+            unsigned long long ns[2];
+            for (int k = 0; k < 2; k++) gl.GetQueryObjectui64v(aaTimer.queries[k], GL_QUERY_RESULT, &ns[k]);
+            aaSceneMs = ns[0] / 1e6;
+            aaPostMs = ns[1] / 1e6;
+            aaTimer.pending = false;
+        }
+    }
+    bool timed = gl.timer && !aaTimer.pending && !timingPoll;
+
+    GLuint target = 0;
+    if (msaa || (fxaa && !toIdBuffer)) target = aaTarget.fbo;
+    else if (mrt) target = idBuffer.fbo;
+    if (gl.fbo) gl.BindFramebuffer(GL_FRAMEBUFFER, target);
+    if (mrt) {
+        glDrawBuffer(GL_COLOR_ATTACHMENT1);
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    }
+    if (timed) gl.BeginQuery(GL_TIME_ELAPSED, aaTimer.queries[0]);
+
+    glClearColor(0.12f, 0.12f, 0.12f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    setupCameraAndLight();
+
+    glPushMatrix();
+    glTranslatef(camCenterX, camCenterY, camCenterZ);
+    glDisable(GL_LIGHTING);
+    glLineWidth(2.0f);
+    glBegin(GL_LINES);
+    glColor3f(1, 0, 0); glVertex3f(0, 0, 0); glVertex3f(0.8f, 0, 0);
+    glColor3f(0, 1, 0); glVertex3f(0, 0, 0); glVertex3f(0, 0.8f, 0);
+    glColor3f(0, 0, 1); glVertex3f(0, 0, 0); glVertex3f(0, 0, 0.8f);
+    glEnd();
+    glPopMatrix();
+
+    if (mrt) {
+        static const GLenum both[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        gl.DrawBuffers(2, both);
+    }
+    drawScene(false);
+
+    if (mrt) {
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        if (idBuffer.readVersion != idBuffer.version) queueIdReadback();
+    }
+    if (timed) {
+        gl.EndQuery(GL_TIME_ELAPSED);
+        gl.BeginQuery(GL_TIME_ELAPSED, aaTimer.queries[1]);
+    }
+
+    // onto the window: FXAA filter, MSAA resolve, or a plain copy of the id-buffer color
+    if (fxaa) {
+        gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+        drawFxaa(toIdBuffer ? idBuffer.color : aaTarget.texture);
+    }
+    else if (target) {
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        gl.BindFramebuffer(GL_READ_FRAMEBUFFER, target);
+        gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        gl.BlitFramebuffer(0, 0, winW, winH, 0, 0, winW, winH, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    if (target) {
+        glDrawBuffer(GL_BACK);
+        glReadBuffer(GL_BACK);
+    }
+    if (timed) {
+        gl.EndQuery(GL_TIME_ELAPSED);
+        aaTimer.pending = true;
+        aaPostName = fxaa ? "FXAA" : msaa ? "resolve" : target ? "copy" : "nothing";
+    }
+
+    if (!headless.active) {
+        drawHud();
+        glutSwapBuffers();
+    }
+    if (aaTimer.pending) {
+        aaTimer.poll = true;
+        schedRequest(DIRTY_HUD); // collect the timings on a later frame
+    }
+
+    // the cursor may rest over a different object after the camera moved
+    if (!updateHover(false)) schedRequest(0); // ids not back yet, look again next frame
 }
 
 static void reshape(int w, int h) {
     winW = max(1, w);
     winH = max(1, h);
     glViewport(0, 0, winW, winH);
-    glutPostRedisplay();
+    schedRequest(DIRTY_ALL);
 }
 
 static void keyboard(unsigned char key, int x, int y) {
+    unsigned dirty = DIRTY_CAMERA;
     switch (key) {
     case 27:
     case 'q':
@@ -267,8 +2170,11 @@ static void keyboard(unsigned char key, int x, int y) {
         camCenterX = camCenterY = camCenterZ = 0.0f;
         break;
     case 'a':
-        useAA = !useAA;
-        cout << "Anti-aliasing " << (useAA ? "ON" : "OFF") << "\n";
+        do aaMode = static_cast<AAMode>((aaMode + 1) % AA_MODE_COUNT);
+        while (!aaModeAvailable(aaMode));
+        cout << "Anti-aliasing: " << aaModeName(aaMode) << "\n";
+        aaSceneMs = aaPostMs = -1.0;
+        dirty = DIRTY_MATERIAL | DIRTY_HUD;
         break;
     case 'w':
         camDist = fmaxf(1.0f, camDist - 0.4f);
@@ -276,16 +2182,85 @@ static void keyboard(unsigned char key, int x, int y) {
     case 's':
         camDist = fminf(50.0f, camDist + 0.4f);
         break;
-    case 'p':
-        for (int i = 0; i < 3; i++) {
+    case 'm': {
+        static const char* names[] = { "GPU color, offscreen async readback", "GPU color, blocking full-frame read",
+            "CPU ray casting", "compare color and ray", "persistent id buffer" };
+        pickMode = static_cast<PickMode>((pickMode + 1) % (useIdBuffer ? 5 : 4));
+        cout << "Pick mode: " << names[pickMode] << "\n";
+        dirty = DIRTY_HUD;
+        break;
+    }
+    case 'n':
+        sceneSizeIndex = (sceneSizeIndex + 1) % (sizeof(sceneSizes) / sizeof(sceneSizes[0]));
+        buildScene(sceneSizes[sceneSizeIndex]);
+        selectedCount = 0;
+        hoveredId = -1;
+        cout << "Scene: " << sceneObjects.size() << " objects\n";
+        dirty = DIRTY_ALL;
+        break;
+    case 'h': {
+        // batched query: every object visible in a box around the cursor, by pixel count
+        const int half = 32;
+        int cx = hoverX >= 0 ? hoverX : winW / 2, cy = hoverY >= 0 ? hoverY : winH / 2;
+        map<int, int> hist;
+        if (!idBufferHistogram(cx - half, cy - half, cx + half, cy + half, hist)) {
+            cout << "Region histogram needs the id buffer\n";
+        }
+        else {
+            vector<pair<int, int> > byCount;
+            for (map<int, int>::const_iterator it = hist.begin(); it != hist.end(); ++it)
+                byCount.push_back(make_pair(it->second, it->first));
+            sort(byCount.rbegin(), byCount.rend());
+            cout << hist.size() << " objects in the " << 2 * half + 1 << "px box around (" << cx << ", " << cy << ")\n";
+            for (size_t k = 0; k < byCount.size() && k < 10; k++)
+                cout << "  obj " << byCount[k].second << ": " << byCount[k].first << " px\n";
+        }
+        dirty = DIRTY_HUD;
+        break;
+    }
+    case 'b':
+        runDrawBenchmark();
+        dirty = 0; // the benchmark requests its own redraw
+        break;
+    case 'd':
+        useLod = !useLod;
+        cout << "Distance LOD " << (useLod ? "ON" : "OFF") << "\n";
+        dirty = DIRTY_MESH | DIRTY_HUD;
+        break;
+    case 'l':
+        selectTool = (selectTool == SELECT_RECT) ? SELECT_LASSO : SELECT_RECT;
+        dirty = DIRTY_HUD;
+        break;
+    case 'o':
+        excludeOccluded = !excludeOccluded;
+        dirty = DIRTY_HUD;
+        break;
+    case 'c':
+        for (size_t i = 0; i < sceneObjects.size(); i++) {
+            sceneObjects[i].selected = false;
+            updateBatchSelection(static_cast<int>(i));
+        }
+        selectedCount = 0;
+        dirty = DIRTY_MATERIAL | DIRTY_HUD;
+        break;
+    case 'p': {
+        int shown = min(static_cast<int>(sceneObjects.size()), 16);
+        for (int i = 0; i < shown; i++) {
             cout << "obj " << i << " color = "
-                << objColor[i][0] << ", "
-                << objColor[i][1] << ", "
-                << objColor[i][2] << "\n";
+                << sceneObjects[i].color[0] << ", "
+                << sceneObjects[i].color[1] << ", "
+                << sceneObjects[i].color[2] << "\n";
         }
+        if (shown < static_cast<int>(sceneObjects.size()))
+            cout << "... " << sceneObjects.size() - shown << " more\n";
+        dirty = 0;
+        break;
+    }
+    default:
+        dirty = 0;
         break;
     }
-    glutPostRedisplay();
+    if (dirty) schedRequest(dirty);
 }
 
 static void specialKey(int key, int x, int y) {
@@ -302,52 +2277,163 @@ static void specialKey(int key, int x, int y) {
     case GLUT_KEY_DOWN:
         camEl = max(-89.0f, camEl - 4.0f);
         break;
+    default:
+        return;
     }
-    glutPostRedisplay();
+    schedRequest(DIRTY_CAMERA);
 }
 
+static void passiveMotion(int x, int y) {
+    hoverX = x;
+    hoverY = y;
+    updateHover(true);
+}
+
+// A left click picks on release; a left drag selects
 static void mouse(int button, int state, int x, int y) {
-    if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
+    if (button != GLUT_LEFT_BUTTON) return;
+    if (state == GLUT_DOWN) {
+        dragStartX = x;
+        dragStartY = y;
+        dragging = false;
+        dragAdd = (glutGetModifiers() & GLUT_ACTIVE_SHIFT) != 0;
+        dragPath.assign(1, make_pair(x, y));
+        return;
+    }
+    if (dragging) {
+        dragPath.push_back(make_pair(x, y));
+        runSelection();
+        dragging = false;
+        dragPath.clear();
+    }
+    else {
         pickAt(x, y);
     }
 }
 
+static void motion(int x, int y) {
+    hoverX = x;
+    hoverY = y;
+    if (!dragging && abs(x - dragStartX) + abs(y - dragStartY) < 5) return;
+    dragging = true;
+    if (selectTool == SELECT_RECT) dragPath.resize(1);
+    dragPath.push_back(make_pair(x, y));
+    schedRequest(DIRTY_HUD);
+}
+
 static void initGL() {
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_NORMALIZE);
     glDisable(GL_COLOR_MATERIAL);
 
-    // Íà÷àëüíûå íàñòðîéêè ñãëàæèâàíèÿ
-    glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
-    glHint(GL_POLYGON_SMOOTH_HINT, GL_NICEST);
-
     srand(static_cast<unsigned int>(time(NULL)));
 }
 
+// Script settings for --headless runs (see headless.h):
+//   camera AZ EL DIST   center X Y Z   aa off|msaa2|msaa4|msaa8|fxaa   lod on|off
+//   objects N [SEED]    select ID...   (random scenes are seeded, 1 by default)
+static bool applyHeadlessSetting(const string& key, istringstream& args) {
+    string word;
+    if (key == "camera") {
+        if (!(args >> camAz >> camEl >> camDist)) return false;
+        schedRequest(DIRTY_CAMERA);
+    }
+    else if (key == "center") {
+        if (!(args >> camCenterX >> camCenterY >> camCenterZ)) return false;
+        schedRequest(DIRTY_CAMERA);
+    }
+    else if (key == "aa") {
+        static const char* names[] = { "off", "msaa2", "msaa4", "msaa8", "fxaa" };
+        if (!(args >> word)) return false;
+        int mode = 0;
+        while (mode < AA_MODE_COUNT && word != names[mode]) mode++;
+        if (mode == AA_MODE_COUNT || !aaModeAvailable(static_cast<AAMode>(mode))) return false;
+        aaMode = static_cast<AAMode>(mode);
+        schedRequest(DIRTY_MATERIAL);
+    }
+    else if (key == "lod") {
+        if (!(args >> word) || (word != "on" && word != "off")) return false;
+        useLod = word == "on";
+        schedRequest(DIRTY_MESH);
+    }
+    else if (key == "objects") {
+        int count = 0;
+        unsigned seed = 1;
+        if (!(args >> count) || count < 1) return false;
+        args >> seed;
+        srand(seed);
+        buildScene(count);
+        selectedCount = 0;
+        schedRequest(DIRTY_ALL);
+    }
+    else if (key == "select") {
+        int id;
+        while (args >> id) {
+            if (id < 0 || id >= static_cast<int>(sceneObjects.size())) return false;
+            if (!sceneObjects[id].selected) selectedCount++;
+            sceneObjects[id].selected = true;
+            updateBatchSelection(id);
+        }
+        schedRequest(DIRTY_MATERIAL);
+    }
+    else return false;
+    return true;
+}
+
 int main(int argc, char** argv) {
-    glutInit(&argc, argv);
+    bool offscreen = headlessFromArgs(argc, argv);
+    if (!offscreen) glutInit(&argc, argv);
+    schedInitFromArgs(argc, argv);
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--bench") == 0) {
+            benchOnStart = true;
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) benchObjects = atoi(argv[++i]);
+        }
 
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitWindowSize(winW, winH);
-    glutCreateWindow("Object Picking - Simple Version");
+    if (offscreen) {
+        if (!headlessInit(winW, winH)) return 1;
+        sched.offscreen = true;
+    }
+    else {
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+        glutInitWindowSize(winW, winH);
+        glutCreateWindow("Object Picking - Simple Version");
+    }
 
     cout << "OpenGL version: " << glGetString(GL_VERSION) << endl;
 
     initGL();
+    glExtInit();
+    initShapes();
+    initAA();
+    buildScene(benchObjects > 0 ? benchObjects : sceneSizes[sceneSizeIndex]);
+    if (useIdBuffer) pickMode = PICK_ID_BUFFER;
+    if (offscreen) return headlessRun(applyHeadlessSetting, display, reshape);
 
     glutDisplayFunc(display);
     glutReshapeFunc(reshape);
     glutKeyboardFunc(keyboard);
     glutSpecialFunc(specialKey);
     glutMouseFunc(mouse);
+    glutPassiveMotionFunc(passiveMotion);
+    glutMotionFunc(motion);
 
     cout << "Controls:\n";
     cout << "  Arrow keys: rotate camera\n";
     cout << "  w/s: zoom in/out\n";
     cout << "  r: reset view\n";
-    cout << "  a: toggle anti-aliasing\n";
+    cout << "  a: cycle anti-aliasing (off / MSAA 2x / 4x / 8x / FXAA)\n";
+    cout << "  m: cycle picking (GPU color async / GPU color blocking / CPU ray casting / compare / persistent id buffer,\n"
+         << "     the default when the GPU can write it every frame)\n";
     cout << "  Click left mouse on objects to pick and randomize their color.\n";
+    cout << "  Drag left mouse to select (l: rectangle / lasso, o: skip occluded objects, shift: add, c: clear)\n";
+    cout << "  Hover highlights the object under the cursor; h: objects around the cursor by pixel count\n";
+    cout << "  n: cycle scene size (3 / 1000 / 10000 / 30000 objects)\n";
     cout << "  p: print current object colors\n";
+    cout << "  d: toggle distance-based level of detail\n";
+    cout << "  b: benchmark fps of glutSolid* vs cached meshes (client arrays / VBOs); --bench [objects] runs it at startup and exits\n";
+    cout << "  Frames are drawn only when something changes; --fps N caps the redraw rate.\n";
+    cout << "  --headless script renders the frames a script describes without a window (see headless.h) and exits.\n";
 
     glutMainLoop();
     return 0;
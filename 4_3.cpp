@@ -4,33 +4,21 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <chrono>
+#include "bezier_core.h"
+#include "bezier_batch.h"
+#include "bezier_model.h"
+#include "bezier_adaptive.h"
+#include "bezier_gpu.h"
+#include "bezier_tess.h"
+#include "frame_scheduler.h"
+#include "headless.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-struct Vec3 {
-    float x, y, z;
-    Vec3() : x(0), y(0), z(0) {}
-    Vec3(float X, float Y, float Z) : x(X), y(Y), z(Z) {}
-    Vec3 operator+(const Vec3& o) const { return Vec3(x + o.x, y + o.y, z + o.z); }
-    Vec3 operator-(const Vec3& o) const { return Vec3(x - o.x, y - o.y, z - o.z); }
-    Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
-};
-
-static Vec3 crossp(const Vec3& a, const Vec3& b) {
-    return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
-}
-
-static float dotp(const Vec3& a, const Vec3& b) {
-    return a.x * b.x + a.y * b.y + a.z * b.z;
-}
-
-static Vec3 normalize(const Vec3& v) {
-    float L = sqrtf(dotp(v, v));
-    return (L > 1e-6f) ? Vec3(v.x / L, v.y / L, v.z / L) : v;
-}
-
 Vec3 ctrl[4][4];
 
 static bool loadControlPointsFromFile(const char* fname) {
@@ -57,60 +45,268 @@ static void setDefaultControlPoints() {
             ctrl[i][j] = Vec3(d[j * 4 + i][0], d[j * 4 + i][1], d[j * 4 + i][2]);
 }
 
-static void bernstein3(float u, float B[4]) {
-    float om = 1 - u;
-    B[0] = om * om * om;
-    B[1] = 3 * u * om * om;
-    B[2] = 3 * u * u * om;
-    B[3] = u * u * u;
-}
-
-static void bernstein3_deriv(float u, float dB[4]) {
-    float om = 1 - u;
-    dB[0] = -3 * om * om;
-    dB[1] = 3 * om * om - 6 * u * om;
-    dB[2] = 6 * u * om - 3 * u * u;
-    dB[3] = 3 * u * u;
-}
-
 static Vec3 evalP(float u, float v) {
-    float Bu[4], Bv[4];
-    bernstein3(u, Bu);
-    bernstein3(v, Bv);
-    Vec3 P;
-    for (int i = 0; i < 4; i++)
-        for (int j = 0; j < 4; j++)
-            P = P + ctrl[i][j] * (Bu[i] * Bv[j]);
-    return P;
+    return bezierEval(ctrl, u, v);
 }
 
-static Vec3 evalPu(float u, float v) {
-    float dBu[4], Bv[4];
-    bernstein3_deriv(u, dBu);
-    bernstein3(v, Bv);
-    Vec3 P;
-    for (int i = 0; i < 4; i++)
-        for (int j = 0; j < 4; j++)
-            P = P + ctrl[i][j] * (dBu[i] * Bv[j]);
-    return P;
+// Power-basis coefficients C[a][b] of P(u,v) = sum C[a][b] u^a v^b.
+// Recomputed once per control-point change (C = M * ctrl * M^T).
+Vec3 powerCoeffs[4][4];
+
+static void updatePowerCoeffs() {
+    bezierToPower(ctrl, powerCoeffs);
 }
 
-static Vec3 evalPv(float u, float v) {
-    float Bu[4], dBv[4];
-    bernstein3(u, Bu);
-    bernstein3_deriv(v, dBv);
-    Vec3 P;
-    for (int i = 0; i < 4; i++)
-        for (int j = 0; j < 4; j++)
-            P = P + ctrl[i][j] * (Bu[i] * dBv[j]);
-    return P;
+static void evalPatch(float u, float v, PatchEval& e, bool second = false) {
+    bezierEvalPower(powerCoeffs, u, v, e, second);
 }
 
 int RES = 12;
+enum EvalMode { EVAL_DIRECT = 0, EVAL_FORWARD_DIFF = 1, EVAL_SIMD_BATCH = 2, EVAL_GPU = 3, EVAL_TESS = 4 };
+EvalMode evalMode = EVAL_DIRECT;
+BatchKernel batchKernel = batchDetectKernel();
+const float fwdDiffTolerance = 1e-3f;
 bool useTex = true;
 float camYawDeg = 45.0f, camPitchDeg = 20.0f, camDistVal = 6.0f;
 GLuint tex;
 
+// Tessellation cache: one vertex per grid point, drawn with indexed vertex arrays.
+// Rebuilt only when RES or the control points change, not on camera moves.
+struct MeshCache {
+    std::vector<Vec3> pos;
+    std::vector<Vec3> nrm;
+    std::vector<float> uv;
+    std::vector<GLuint> idx;
+    std::vector<Vec3> du, dv; // forward-difference scratch
+    BatchGrid batch;          // SIMD batch scratch (SoA)
+    Vec3 ctrlSnapshot[4][4];
+    int res = 0;
+    bool valid = false;
+};
+MeshCache mesh;
+
+static void buildIndices(int N) {
+    mesh.idx.clear();
+    mesh.idx.reserve(static_cast<size_t>(N - 1) * (N - 1) * 6);
+    for (int j = 0; j < N - 1; j++) {
+        for (int i = 0; i < N - 1; i++) {
+            GLuint i00 = j * N + i, i10 = i00 + 1;
+            GLuint i01 = i00 + N, i11 = i01 + 1;
+            mesh.idx.push_back(i00); mesh.idx.push_back(i10); mesh.idx.push_back(i11);
+            mesh.idx.push_back(i00); mesh.idx.push_back(i11); mesh.idx.push_back(i01);
+        }
+    }
+}
+
+static void rebuildMesh() {
+    int N = RES;
+    size_t count = static_cast<size_t>(N) * N;
+    mesh.pos.resize(count);
+    mesh.nrm.resize(count);
+    mesh.uv.resize(count * 2);
+    if (evalMode == EVAL_FORWARD_DIFF) {
+        Vec3 du[4][4], dv[4][4];
+        derivativeNets(ctrl, du, dv);
+        mesh.du.resize(count);
+        mesh.dv.resize(count);
+        forwardDiffGrid(ctrl, N - 1, mesh.pos.data());
+        forwardDiffGrid(du, N - 1, mesh.du.data());
+        forwardDiffGrid(dv, N - 1, mesh.dv.data());
+        for (size_t k = 0; k < count; k++) mesh.nrm[k] = normalize(crossp(mesh.du[k], mesh.dv[k]));
+    }
+    else if (evalMode == EVAL_SIMD_BATCH) {
+        BatchCoeffs c;
+        updatePowerCoeffs();
+        batchLoadCoeffs(c, &powerCoeffs[0][0].x);
+        mesh.batch.resize(count, N);
+        batchEvalGrid(batchKernel, c, N, N, mesh.batch.out(), mesh.batch.us.data());
+        batchGridToAoS(mesh.batch, count, &mesh.pos[0].x, &mesh.nrm[0].x);
+    }
+    else {
+        updatePowerCoeffs();
+    }
+    PatchEval e;
+    for (int j = 0; j < N; j++) {
+        float v = j / float(N - 1);
+        for (int i = 0; i < N; i++) {
+            float u = i / float(N - 1);
+            size_t k = static_cast<size_t>(j) * N + i;
+            if (evalMode == EVAL_DIRECT) {
+                evalPatch(u, v, e);
+                mesh.pos[k] = e.P;
+                mesh.nrm[k] = normalize(crossp(e.Pu, e.Pv));
+            }
+            mesh.uv[k * 2] = u;
+            mesh.uv[k * 2 + 1] = v;
+        }
+    }
+    if (mesh.res != N) buildIndices(N);
+    mesh.res = N;
+    memcpy(mesh.ctrlSnapshot, ctrl, sizeof(ctrl));
+    mesh.valid = true;
+}
+
+// Max distance of forward-differenced positions from direct evaluation
+static void reportForwardDiffError(int N) {
+    std::vector<Vec3> grid(static_cast<size_t>(N) * N);
+    forwardDiffGrid(ctrl, N - 1, grid.data());
+    float maxErr = 0.0f;
+    for (int j = 0; j < N; j++)
+        for (int i = 0; i < N; i++) {
+            Vec3 d = grid[static_cast<size_t>(j) * N + i] - evalP(i / float(N - 1), j / float(N - 1));
+            maxErr = std::max(maxErr, sqrtf(dotp(d, d)));
+        }
+    std::cout << "Forward differencing at " << N << "x" << N << ": max deviation " << maxErr
+        << (maxErr <= fwdDiffTolerance ? " (within tolerance)\n" : " (EXCEEDS tolerance)\n");
+}
+
+// Multi-patch model loaded from a .bpt file; when non-empty it replaces ctrl
+BezierModel model;
+ModelMesh modelMesh;
+bool modelDirty = false;
+
+// View-dependent adaptive tessellation of the single patch (replaces RES when on)
+bool adaptive = false;
+float pixelTol = 1.0f;
+const int adaptiveMaxDepth = 10;
+AdaptiveMesh adaptiveMesh;
+AdaptiveView adaptiveLastView;
+
+// Called from drawPatch() after gluLookAt, so the GL matrices describe this frame
+static void ensureAdaptiveMesh() {
+    GLdouble proj[16], mv[16];
+    glGetDoublev(GL_PROJECTION_MATRIX, proj);
+    glGetDoublev(GL_MODELVIEW_MATRIX, mv);
+    AdaptiveView view;
+    adaptiveSetView(view, proj, mv, headlessWindowWidth(), headlessWindowHeight());
+    if (mesh.valid && memcmp(&view, &adaptiveLastView, sizeof(view)) == 0 &&
+        memcmp(mesh.ctrlSnapshot, ctrl, sizeof(ctrl)) == 0) return;
+    adaptiveLastView = view;
+
+    BezierNet net;
+    memcpy(net.p, ctrl, sizeof(net.p));
+    tessellateAdaptive(net, view, pixelTol, adaptiveMaxDepth, adaptiveMesh);
+    size_t count = adaptiveMesh.pos.size() / 3;
+    mesh.pos.resize(count);
+    mesh.nrm.resize(count);
+    memcpy(&mesh.pos[0].x, adaptiveMesh.pos.data(), count * sizeof(Vec3));
+    memcpy(&mesh.nrm[0].x, adaptiveMesh.nrm.data(), count * sizeof(Vec3));
+    mesh.uv = adaptiveMesh.uv;
+    mesh.idx = adaptiveMesh.idx;
+    mesh.res = -1; // forces the grid path to rebuild when adaptive is switched off
+    memcpy(mesh.ctrlSnapshot, ctrl, sizeof(ctrl));
+    mesh.valid = true;
+}
+
+static WorkStealingPool& tessPool() {
+    static WorkStealingPool pool;
+    return pool;
+}
+
+// EVAL_GPU on the single patch: the vertex shader evaluates it on a static (u,v)
+// grid and lights it like the fixed-function LIGHT0/material set in drawPatch()
+GpuPatch gpuPatch;
+GLint gpuUseTexLoc = -1;
+
+static const char* gpuShadeVS =
+    "vec4 shade(vec3 P, vec3 N) {\n"
+    "    vec3 n = normalize(gl_NormalMatrix * N);\n"
+    "    vec3 e = vec3(gl_ModelViewMatrix * vec4(P, 1.0));\n"
+    "    vec3 l = normalize(gl_LightSource[0].position.xyz - e * gl_LightSource[0].position.w);\n"
+    "    float ndotl = dot(n, l);\n"
+    "    vec4 c = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient +\n"
+    "        max(ndotl, 0.0) * gl_FrontLightProduct[0].diffuse;\n"
+    "    if (ndotl > 0.0)\n"
+    "        c += pow(max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0), gl_FrontMaterial.shininess) *\n"
+    "            gl_FrontLightProduct[0].specular;\n"
+    "    return vec4(clamp(c.rgb, 0.0, 1.0), gl_FrontMaterial.diffuse.a);\n"
+    "}\n";
+
+static const char* gpuShadeFS =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "uniform int useTex;\n"
+    "void main() {\n"
+    "    gl_FragColor = useTex != 0 ? gl_Color * texture2D(tex, gl_TexCoord[0].st) : gl_Color;\n"
+    "}\n";
+
+// Builds the shader path on first use; false when the context cannot run it
+static bool gpuReady() {
+    if (gpuPatch.tried) return gpuPatch.program != 0;
+    if (!gpuPatchInit(gpuPatch, gpuShadeVS, gpuShadeFS)) return false;
+    gpuUseTexLoc = glExt.GetUniformLocation(gpuPatch.program, "useTex");
+    return true;
+}
+
+static bool drawsOnGpu() {
+    return evalMode == EVAL_GPU && model.patches.empty() && !adaptive;
+}
+
+// EVAL_TESS: every net (the patch or the whole model) is a GL_PATCHES primitive,
+// tessellated per edge to about tessEdgePixels per segment; replaces RES and adaptive
+TessPatches tessPatches;
+GLint tessUseTexLoc = -1, tessTwoSideLoc = -1;
+float tessEdgePixels = 8.0f;
+bool tessNetsValid = false;
+Vec3 tessCtrlSnapshot[4][4];
+
+static const char* tessShadeFS =
+    "#version 400 compatibility\n"
+    "in vec4 color;\n"
+    "in vec4 backColor;\n"
+    "in vec2 texcoord;\n"
+    "uniform sampler2D tex;\n"
+    "uniform int useTex;\n"
+    "uniform int twoSide;\n"
+    "void main() {\n"
+    "    vec4 c = (twoSide != 0 && !gl_FrontFacing) ? backColor : color;\n"
+    "    gl_FragColor = useTex != 0 ? c * texture(tex, texcoord) : c;\n"
+    "}\n";
+
+static bool tessReady() {
+    if (tessPatches.tried) return tessPatches.program != 0;
+    // same per-vertex lighting as the vertex-shader path, evaluated per tessellated vertex
+    if (!tessPatchesInit(tessPatches, gpuShadeVS, tessShadeFS)) return false;
+    tessUseTexLoc = glExt.GetUniformLocation(tessPatches.program, "useTex");
+    tessTwoSideLoc = glExt.GetUniformLocation(tessPatches.program, "twoSide");
+    return true;
+}
+
+// Upload the nets once for a model (loaded at startup), again whenever the single patch changed
+static void ensureTessNets() {
+    if (!model.patches.empty()) {
+        if (tessNetsValid) return;
+        tessPatchesUpload(tessPatches, model.patches[0].p, model.patches.size());
+    }
+    else {
+        if (tessNetsValid && memcmp(tessCtrlSnapshot, ctrl, sizeof(ctrl)) == 0) return;
+        tessPatchesUpload(tessPatches, &ctrl[0][0].x, 1);
+        memcpy(tessCtrlSnapshot, ctrl, sizeof(ctrl));
+    }
+    tessNetsValid = true;
+}
+
+static void ensureMesh() {
+    if (evalMode == EVAL_TESS) return; // drawPatch() submits the nets instead
+    if (!model.patches.empty()) {
+        if (!modelDirty && modelMesh.res == RES) return;
+        auto t0 = std::chrono::steady_clock::now();
+        tessellateModel(model, RES, batchKernel, tessPool(), modelMesh);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "Tessellated " << model.patches.size() << " patches at " << RES << "x" << RES
+            << " in " << ms << " ms on " << tessPool().size() << " threads\n";
+        modelDirty = false;
+        return;
+    }
+    if (adaptive) {
+        ensureAdaptiveMesh();
+        return;
+    }
+    if (evalMode == EVAL_GPU) return; // drawPatch() uploads the control points instead
+    if (!mesh.valid || mesh.res != RES || memcmp(mesh.ctrlSnapshot, ctrl, sizeof(ctrl)) != 0)
+        rebuildMesh();
+}
+
 static void makeTex(int N = 256) {
     std::vector<unsigned char> img(N * N * 3);
     for (int j = 0; j < N; j++) {
@@ -141,9 +337,12 @@ static void drawPatch() {
     GLfloat mat_diffuse[] = { 0.7f, 0.7f, 0.7f, 1.0f };
     GLfloat mat_specular[] = { 0.6f, 0.6f, 0.6f, 1.0f };
     GLfloat mat_shininess[] = { 32.0f };
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-    glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
+    // .bpt models mix patch orientations, so light both sides there
+    GLenum face = model.patches.empty() ? GL_FRONT : GL_FRONT_AND_BACK;
+    glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, model.patches.empty() ? GL_FALSE : GL_TRUE);
+    glMaterialfv(face, GL_DIFFUSE, mat_diffuse);
+    glMaterialfv(face, GL_SPECULAR, mat_specular);
+    glMaterialfv(face, GL_SHININESS, mat_shininess);
 
     GLfloat light_pos[] = { 5.0f, 5.0f, 5.0f, 1.0f };
     GLfloat light_diffuse[] = { 1.0f, 1.0f, 1.0f, 1.0f };
@@ -161,67 +360,59 @@ static void drawPatch() {
         glDisable(GL_TEXTURE_2D);
     }
 
-    glBegin(GL_TRIANGLES);
-    for (int j = 0; j < RES - 1; j++) {
-        for (int i = 0; i < RES - 1; i++) {
-            float u1 = i / float(RES - 1);
-            float u2 = (i + 1) / float(RES - 1);
-            float v1 = j / float(RES - 1);
-            float v2 = (j + 1) / float(RES - 1);
-
-            Vec3 p00 = evalP(u1, v1);
-            Vec3 p10 = evalP(u2, v1);
-            Vec3 p01 = evalP(u1, v2);
-            Vec3 p11 = evalP(u2, v2);
-
-            Vec3 pu00 = evalPu(u1, v1);
-            Vec3 pv00 = evalPv(u1, v1);
-            Vec3 n00 = normalize(crossp(pu00, pv00));
-
-            Vec3 pu10 = evalPu(u2, v1);
-            Vec3 pv10 = evalPv(u2, v1);
-            Vec3 n10 = normalize(crossp(pu10, pv10));
-
-            Vec3 pu01 = evalPu(u1, v2);
-            Vec3 pv01 = evalPv(u1, v2);
-            Vec3 n01 = normalize(crossp(pu01, pv01));
-
-            Vec3 pu11 = evalPu(u2, v2);
-            Vec3 pv11 = evalPv(u2, v2);
-            Vec3 n11 = normalize(crossp(pu11, pv11));
+    ensureMesh();
 
-            glNormal3f(n00.x, n00.y, n00.z);
-            glTexCoord2f(u1, v1); glVertex3f(p00.x, p00.y, p00.z);
-
-            glNormal3f(n10.x, n10.y, n10.z);
-            glTexCoord2f(u2, v1); glVertex3f(p10.x, p10.y, p10.z);
-
-            glNormal3f(n11.x, n11.y, n11.z);
-            glTexCoord2f(u2, v2); glVertex3f(p11.x, p11.y, p11.z);
-
-            glNormal3f(n00.x, n00.y, n00.z);
-            glTexCoord2f(u1, v1); glVertex3f(p00.x, p00.y, p00.z);
-
-            glNormal3f(n11.x, n11.y, n11.z);
-            glTexCoord2f(u2, v2); glVertex3f(p11.x, p11.y, p11.z);
+    if (evalMode == EVAL_TESS) {
+        ensureTessNets();
+        tessPatchesBind(tessPatches, headlessWindowWidth(), headlessWindowHeight(), tessEdgePixels);
+        glExt.Uniform1i(tessUseTexLoc, useTex ? 1 : 0);
+        glExt.Uniform1i(tessTwoSideLoc, model.patches.empty() ? 0 : 1);
+        tessPatchesDraw(tessPatches);
+        glDisable(GL_TEXTURE_2D);
+        return;
+    }
+    if (drawsOnGpu()) {
+        gpuPatchSetGrid(gpuPatch, RES);
+        gpuPatchBind(gpuPatch, &ctrl[0][0].x);
+        glExt.Uniform1i(gpuUseTexLoc, useTex ? 1 : 0);
+        gpuPatchDraw(gpuPatch);
+        glDisable(GL_TEXTURE_2D);
+        return;
+    }
 
-            glNormal3f(n01.x, n01.y, n01.z);
-            glTexCoord2f(u1, v2); glVertex3f(p01.x, p01.y, p01.z);
-        }
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    if (!model.patches.empty()) {
+        glVertexPointer(3, GL_FLOAT, 0, modelMesh.pos.data());
+        glNormalPointer(GL_FLOAT, 0, modelMesh.nrm.data());
+        glTexCoordPointer(2, GL_FLOAT, 0, modelMesh.uv.data());
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(modelMesh.idx.size()), GL_UNSIGNED_INT, modelMesh.idx.data());
+    }
+    else {
+        glVertexPointer(3, GL_FLOAT, sizeof(Vec3), mesh.pos.data());
+        glNormalPointer(GL_FLOAT, sizeof(Vec3), mesh.nrm.data());
+        glTexCoordPointer(2, GL_FLOAT, 0, mesh.uv.data());
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.idx.size()), GL_UNSIGNED_INT, mesh.idx.data());
     }
-    glEnd();
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
 
     glDisable(GL_TEXTURE_2D);
 }
 
 static void display() {
+    // mesh changes are picked up lazily by ensureMesh(), once per frame
+    schedBeginFrame();
+
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    int w = glutGet(GLUT_WINDOW_WIDTH);
-    int h = glutGet(GLUT_WINDOW_HEIGHT);
+    int w = headlessWindowWidth();
+    int h = headlessWindowHeight();
     gluPerspective(45.0, static_cast<double>(w) / static_cast<double>(h), 0.1, 100.0);
 
     glMatrixMode(GL_MODELVIEW);
@@ -237,20 +428,59 @@ static void display() {
 
     drawPatch();
 
-    glutSwapBuffers();
+    if (!headless.active) glutSwapBuffers();
 }
 
 static void keys(unsigned char k, int, int) {
     if (k == 27 || k == 'q') exit(0);
+    unsigned dirty = 0;
+    if (k == 'w' || k == 's') dirty |= DIRTY_CAMERA;
+    if (k == 't') dirty |= DIRTY_MATERIAL;
+    if (k == 'g' || k == 'v' || k == '+' || k == '-') dirty |= DIRTY_MESH;
     if (k == 'w') camDistVal = std::max(0.5f, camDistVal - 0.3f);
     if (k == 's') camDistVal += 0.3f;
     if (k == 't') {
         useTex = !useTex;
         std::cout << "Texture " << (useTex ? "ON" : "OFF") << "\n";
     }
-    if (k == '+') { RES = std::min(50, RES + 2); std::cout << "Resolution: " << RES << "\n"; }
-    if (k == '-') { RES = std::max(4, RES - 2); std::cout << "Resolution: " << RES << "\n"; }
-    glutPostRedisplay();
+    if (k == 'g') {
+        static const char* names[] = { "direct power basis", "forward differencing", "SIMD batch", "vertex shader",
+            "tessellation shaders" };
+        evalMode = static_cast<EvalMode>((evalMode + 1) % 5);
+        if (evalMode == EVAL_GPU && !gpuReady()) evalMode = EVAL_TESS;
+        if (evalMode == EVAL_TESS && !tessReady()) evalMode = EVAL_DIRECT;
+        mesh.valid = false;
+        std::cout << "Evaluation: " << names[evalMode];
+        if (evalMode == EVAL_SIMD_BATCH) std::cout << " (" << batchKernelName(batchKernel) << ")";
+        if (evalMode == EVAL_GPU && !model.patches.empty()) std::cout << " (single patch only; the model stays on the CPU)";
+        if (evalMode == EVAL_TESS) std::cout << " (" << tessEdgePixels << " px per edge segment)";
+        std::cout << "\n";
+        if (evalMode == EVAL_FORWARD_DIFF) {
+            reportForwardDiffError(RES);
+            reportForwardDiffError(4096);
+        }
+    }
+    if (k == 'v') {
+        // per-patch adaptive refinement would crack along shared model edges
+        if (!model.patches.empty()) std::cout << "Adaptive tessellation is only available for the single patch\n";
+        else {
+            adaptive = !adaptive;
+            mesh.valid = false;
+            std::cout << "Adaptive tessellation " << (adaptive ? "ON" : "OFF") << "\n";
+        }
+    }
+    if (evalMode == EVAL_TESS && (k == '+' || k == '-')) {
+        tessEdgePixels = (k == '+') ? std::max(1.0f, tessEdgePixels * 0.5f) : std::min(256.0f, tessEdgePixels * 2.0f);
+        std::cout << "Tessellation target: " << tessEdgePixels << " px per edge segment\n";
+    }
+    else if (adaptive && (k == '+' || k == '-')) {
+        pixelTol = (k == '+') ? std::max(0.125f, pixelTol * 0.5f) : std::min(64.0f, pixelTol * 2.0f);
+        mesh.valid = false;
+        std::cout << "Adaptive tolerance: " << pixelTol << " px\n";
+    }
+    else if (k == '+') { RES = std::min(50, RES + 2); std::cout << "Resolution: " << RES << "\n"; }
+    else if (k == '-') { RES = std::max(4, RES - 2); std::cout << "Resolution: " << RES << "\n"; }
+    if (dirty) schedRequest(dirty);
 }
 
 static void special(int key, int, int) {
@@ -258,7 +488,7 @@ static void special(int key, int, int) {
     if (key == GLUT_KEY_RIGHT) camYawDeg += 5;
     if (key == GLUT_KEY_UP) camPitchDeg = std::min(89.0f, camPitchDeg + 5);
     if (key == GLUT_KEY_DOWN) camPitchDeg = std::max(-89.0f, camPitchDeg - 5);
-    glutPostRedisplay();
+    schedRequest(DIRTY_CAMERA);
 }
 
 static void init() {
@@ -269,16 +499,82 @@ static void init() {
     glEnable(GL_NORMALIZE);
 }
 
+// Script settings for --headless runs (see headless.h):
+//   camera AZ EL DIST   res N   eval direct|fwd-diff|batch|gpu|tess   adaptive on|off   tol PX   texture on|off
+//   edge PX (tessellation shaders: pixels per edge segment)
+static bool applyHeadlessSetting(const std::string& key, std::istringstream& args) {
+    std::string word;
+    if (key == "camera") {
+        if (!(args >> camYawDeg >> camPitchDeg >> camDistVal)) return false;
+    }
+    else if (key == "res") {
+        if (!(args >> RES) || RES < 2) return false;
+    }
+    else if (key == "eval") {
+        static const char* names[] = { "direct", "fwd-diff", "batch", "gpu", "tess" };
+        if (!(args >> word)) return false;
+        int mode = 0;
+        while (mode < 5 && word != names[mode]) mode++;
+        if (mode == 5 || (mode == EVAL_GPU && !gpuReady()) || (mode == EVAL_TESS && !tessReady())) return false;
+        evalMode = static_cast<EvalMode>(mode);
+        mesh.valid = false;
+    }
+    else if (key == "adaptive" || key == "texture") {
+        if (!(args >> word) || (word != "on" && word != "off")) return false;
+        if (key == "texture") useTex = word == "on";
+        else if (model.patches.empty()) adaptive = word == "on";
+        else return false;
+        mesh.valid = false;
+    }
+    else if (key == "tol") {
+        if (!(args >> pixelTol) || pixelTol <= 0.0f) return false;
+        mesh.valid = false;
+    }
+    else if (key == "edge") {
+        if (!(args >> tessEdgePixels) || tessEdgePixels <= 0.0f) return false;
+    }
+    else return false;
+    return true;
+}
+
 int main(int argc, char** argv) {
     if (!loadControlPointsFromFile("patchPoints.txt"))
         setDefaultControlPoints();
 
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
-    glutInitWindowSize(1000, 700);
-    glutCreateWindow("Bezier Patch - Fixed Version");
+    bool offscreen = headlessFromArgs(argc, argv);
+    if (!offscreen) glutInit(&argc, argv);
+    schedInitFromArgs(argc, argv);
+
+    // optional multi-patch model: 4_3 teapot.bpt
+    if (argc > 1) {
+        if (loadBptModel(argv[1], model)) {
+            float r2 = 0.0f;
+            for (size_t p = 0; p < model.patches.size(); p++)
+                for (int k = 0; k < 16; k++) {
+                    const float* q = &model.patches[p].p[k * 3];
+                    r2 = std::max(r2, q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
+                }
+            camDistVal = std::max(camDistVal, 2.5f * sqrtf(r2));
+            modelDirty = true;
+            std::cout << "Loaded " << model.patches.size() << " patches from " << argv[1] << "\n";
+        }
+        else {
+            std::cerr << "Could not load bicubic patch model " << argv[1] << "\n";
+        }
+    }
+
+    if (offscreen) {
+        if (!headlessInit(1000, 700)) return 1;
+        sched.offscreen = true;
+    }
+    else {
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
+        glutInitWindowSize(1000, 700);
+        glutCreateWindow("Bezier Patch - Fixed Version");
+    }
 
     init();
+    if (offscreen) return headlessRun(applyHeadlessSetting, display);
 
     glutDisplayFunc(display);
     glutKeyboardFunc(keys);
@@ -288,7 +584,11 @@ int main(int argc, char** argv) {
         << "  Arrow keys: rotate camera\n"
         << "  W/S: zoom in/out\n"
         << "  T: toggle texture\n"
-        << "  +/-: increase/decrease resolution\n"
+        << "  G: cycle tessellation (direct / forward-difference / SIMD batch / vertex shader / tessellation shaders)\n"
+        << "  +/-: increase/decrease resolution (adaptive: halve/double pixel tolerance; tessellation shaders: pixels per edge segment)\n"
+        << "  V: toggle view-dependent adaptive tessellation\n"
+        << "  Usage: 4_3 [--fps N] [--headless script] [model.bpt]; --fps caps the redraw rate, a .bpt model is tessellated in parallel\n"
+        << "  --headless renders the frames a script describes without a window (see headless.h) and exits\n"
         << "  Q or Esc: quit\n";
 
     glutMainLoop();
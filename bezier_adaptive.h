@@ -0,0 +1,202 @@
+// View-dependent adaptive tessellation of one bicubic patch.
+// The net is split recursively with de Casteljau until the projected control
+// points of each sub-net lie within `pixelTol` of the bilinear patch through its
+// corners (convex-hull flatness). Leaves are triangulated as fans that include
+// every neighbouring leaf corner on their edges, so T-junctions never crack.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "bezier_model.h"
+
+struct AdaptiveMesh {
+    std::vector<float> pos, nrm, uv; // xyz, xyz, uv per vertex
+    std::vector<uint32_t> idx;
+    int leaves = 0;
+    int deepest = 0;
+};
+
+struct AdaptiveView {
+    float mvp[16];   // column-major projection * modelview
+    float width, height;
+};
+
+// mvp = proj * view for column-major GL matrices
+static inline void adaptiveSetView(AdaptiveView& view, const double proj[16], const double mv[16],
+    int width, int height) {
+    for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 4; r++) {
+            double s = 0.0;
+            for (int k = 0; k < 4; k++) s += proj[k * 4 + r] * mv[c * 4 + k];
+            view.mvp[c * 4 + r] = static_cast<float>(s);
+        }
+    view.width = static_cast<float>(width);
+    view.height = static_cast<float>(height);
+}
+
+// Split a net at t = 0.5 along u (i) or v (j)
+static inline void adaptiveSplit(const float in[48], float a[48], float b[48], bool alongU) {
+    for (int line = 0; line < 4; line++)
+        for (int k = 0; k < 3; k++) {
+            float p[4];
+            for (int t = 0; t < 4; t++) p[t] = alongU ? in[(t * 4 + line) * 3 + k] : in[(line * 4 + t) * 3 + k];
+            float p01 = 0.5f * (p[0] + p[1]), p12 = 0.5f * (p[1] + p[2]), p23 = 0.5f * (p[2] + p[3]);
+            float p012 = 0.5f * (p01 + p12), p123 = 0.5f * (p12 + p23);
+            float mid = 0.5f * (p012 + p123);
+            float lo[4] = { p[0], p01, p012, mid };
+            float hi[4] = { mid, p123, p23, p[3] };
+            for (int t = 0; t < 4; t++) {
+                int o = alongU ? (t * 4 + line) * 3 + k : (line * 4 + t) * 3 + k;
+                a[o] = lo[t];
+                b[o] = hi[t];
+            }
+        }
+}
+
+// Max screen distance (pixels) of the projected control points from the bilinear
+// interpolation of the projected corners. 0 when the net is entirely behind the
+// eye or off one side of the viewport, so hidden regions stay coarse.
+static inline float adaptiveScreenError(const float net[48], const AdaptiveView& view) {
+    float sx[16], sy[16];
+    int behind = 0, left = 0, right = 0, below = 0, above = 0;
+    for (int k = 0; k < 16; k++) {
+        const float* p = &net[k * 3];
+        const float* m = view.mvp;
+        float x = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+        float y = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+        float w = m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15];
+        if (w <= 1e-6f) { behind++; continue; }
+        if (x < -w) left++;
+        if (x > w) right++;
+        if (y < -w) below++;
+        if (y > w) above++;
+        sx[k] = (x / w * 0.5f + 0.5f) * view.width;
+        sy[k] = (y / w * 0.5f + 0.5f) * view.height;
+    }
+    if (behind == 16 || left == 16 || right == 16 || below == 16 || above == 16) return 0.0f;
+    if (behind > 0) return 1e30f;
+    float err = 0.0f;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++) {
+            float s = i / 3.0f, t = j / 3.0f;
+            float bx = (1 - s) * (1 - t) * sx[0] + s * (1 - t) * sx[12] + (1 - s) * t * sx[3] + s * t * sx[15];
+            float by = (1 - s) * (1 - t) * sy[0] + s * (1 - t) * sy[12] + (1 - s) * t * sy[3] + s * t * sy[15];
+            float dx = sx[i * 4 + j] - bx, dy = sy[i * 4 + j] - by;
+            err = std::max(err, dx * dx + dy * dy);
+        }
+    return sqrtf(err);
+}
+
+struct AdaptiveLeaf {
+    uint32_t iu, iv, size; // dyadic origin and edge length in units of 2^-maxDepth
+};
+
+static inline void adaptiveRefine(const float net[48], const AdaptiveView& view, float pixelTol,
+    int depth, int maxDepth, uint32_t iu, uint32_t iv, std::vector<AdaptiveLeaf>& leaves, int& deepest) {
+    uint32_t size = 1u << (maxDepth - depth);
+    if (depth >= maxDepth || adaptiveScreenError(net, view) <= pixelTol) {
+        AdaptiveLeaf leaf = { iu, iv, size };
+        leaves.push_back(leaf);
+        deepest = std::max(deepest, depth);
+        return;
+    }
+    float u0[48], u1[48], q[4][48];
+    adaptiveSplit(net, u0, u1, true);
+    adaptiveSplit(u0, q[0], q[1], false);
+    adaptiveSplit(u1, q[2], q[3], false);
+    uint32_t h = size / 2;
+    adaptiveRefine(q[0], view, pixelTol, depth + 1, maxDepth, iu, iv, leaves, deepest);
+    adaptiveRefine(q[1], view, pixelTol, depth + 1, maxDepth, iu, iv + h, leaves, deepest);
+    adaptiveRefine(q[2], view, pixelTol, depth + 1, maxDepth, iu + h, iv, leaves, deepest);
+    adaptiveRefine(q[3], view, pixelTol, depth + 1, maxDepth, iu + h, iv + h, leaves, deepest);
+}
+
+static inline uint32_t adaptiveVertex(const BatchCoeffs& c, uint32_t iu, uint32_t iv, float scale,
+    std::unordered_map<uint32_t, uint32_t>& lookup, AdaptiveMesh& mesh) {
+    uint32_t key = (iu << 16) | iv;
+    std::unordered_map<uint32_t, uint32_t>::iterator it = lookup.find(key);
+    if (it != lookup.end()) return it->second;
+    uint32_t index = static_cast<uint32_t>(mesh.uv.size() / 2);
+    float u = iu * scale, v = iv * scale;
+    float p[3], n[3];
+    BatchOut out = { &p[0], &p[1], &p[2], &n[0], &n[1], &n[2] };
+    BatchRow row;
+    batchSetupRow(c, v, row);
+    batchRowScalar(row, &u, 0, 1, out, 0);
+    mesh.pos.insert(mesh.pos.end(), p, p + 3);
+    mesh.nrm.insert(mesh.nrm.end(), n, n + 3);
+    mesh.uv.push_back(u);
+    mesh.uv.push_back(v);
+    lookup[key] = index;
+    return index;
+}
+
+// Tessellate `net` for the given view; maxDepth <= 15 (dyadic coordinates use 16 bits)
+static inline void tessellateAdaptive(const BezierNet& net, const AdaptiveView& view, float pixelTol,
+    int maxDepth, AdaptiveMesh& mesh) {
+    std::vector<AdaptiveLeaf> leaves;
+    mesh.deepest = 0;
+    adaptiveRefine(net.p, view, pixelTol, 0, maxDepth, 0, 0, leaves, mesh.deepest);
+
+    // corners of every leaf, listed per constant-u and constant-v line
+    std::unordered_map<uint32_t, std::vector<uint32_t> > uLines, vLines;
+    for (size_t k = 0; k < leaves.size(); k++) {
+        const AdaptiveLeaf& l = leaves[k];
+        for (int c = 0; c < 4; c++) {
+            uint32_t cu = l.iu + ((c & 1) ? l.size : 0);
+            uint32_t cv = l.iv + ((c & 2) ? l.size : 0);
+            uLines[cu].push_back(cv);
+            vLines[cv].push_back(cu);
+        }
+    }
+    for (std::unordered_map<uint32_t, std::vector<uint32_t> >::iterator it = uLines.begin(); it != uLines.end(); ++it) {
+        std::sort(it->second.begin(), it->second.end());
+        it->second.erase(std::unique(it->second.begin(), it->second.end()), it->second.end());
+    }
+    for (std::unordered_map<uint32_t, std::vector<uint32_t> >::iterator it = vLines.begin(); it != vLines.end(); ++it) {
+        std::sort(it->second.begin(), it->second.end());
+        it->second.erase(std::unique(it->second.begin(), it->second.end()), it->second.end());
+    }
+
+    BatchCoeffs c;
+    batchCoeffsFromNet(net, c);
+    float scale = 1.0f / static_cast<float>(1u << maxDepth);
+    std::unordered_map<uint32_t, uint32_t> lookup;
+    mesh.pos.clear(); mesh.nrm.clear(); mesh.uv.clear(); mesh.idx.clear();
+
+    std::vector<uint32_t> ring;
+    for (size_t k = 0; k < leaves.size(); k++) {
+        const AdaptiveLeaf& l = leaves[k];
+        uint32_t u0 = l.iu, u1 = l.iu + l.size, v0 = l.iv, v1 = l.iv + l.size;
+        ring.clear();
+        // counter-clockwise in (u,v): bottom, right, top, left; interior points come from finer neighbours
+        const std::vector<uint32_t>& bottom = vLines[v0];
+        for (std::vector<uint32_t>::const_iterator p = std::lower_bound(bottom.begin(), bottom.end(), u0);
+            p != bottom.end() && *p < u1; ++p) ring.push_back(adaptiveVertex(c, *p, v0, scale, lookup, mesh));
+        const std::vector<uint32_t>& right = uLines[u1];
+        for (std::vector<uint32_t>::const_iterator p = std::lower_bound(right.begin(), right.end(), v0);
+            p != right.end() && *p < v1; ++p) ring.push_back(adaptiveVertex(c, u1, *p, scale, lookup, mesh));
+        const std::vector<uint32_t>& top = vLines[v1];
+        for (std::vector<uint32_t>::const_iterator p = std::upper_bound(top.begin(), top.end(), u1);
+            p != top.begin() && *(p - 1) > u0; --p) ring.push_back(adaptiveVertex(c, *(p - 1), v1, scale, lookup, mesh));
+        const std::vector<uint32_t>& leftLine = uLines[u0];
+        for (std::vector<uint32_t>::const_iterator p = std::upper_bound(leftLine.begin(), leftLine.end(), v1);
+            p != leftLine.begin() && *(p - 1) > v0; --p) ring.push_back(adaptiveVertex(c, u0, *(p - 1), scale, lookup, mesh));
+
+        if (ring.size() == 4) {
+            uint32_t q[6] = { ring[0], ring[1], ring[2], ring[0], ring[2], ring[3] };
+            mesh.idx.insert(mesh.idx.end(), q, q + 6);
+            continue;
+        }
+        uint32_t center = adaptiveVertex(c, u0 + l.size / 2, v0 + l.size / 2, scale, lookup, mesh);
+        for (size_t r = 0; r < ring.size(); r++) {
+            mesh.idx.push_back(center);
+            mesh.idx.push_back(ring[r]);
+            mesh.idx.push_back(ring[(r + 1) % ring.size()]);
+        }
+    }
+    mesh.leaves = static_cast<int>(leaves.size());
+}
@@ -0,0 +1,232 @@
+// Batch evaluation of a bicubic patch into structure-of-arrays output.
+// Evaluates a whole row of u samples at one v per call, several u per SIMD lane.
+// Kernel (AVX2+FMA, SSE2 or scalar) is picked at runtime from the CPU.
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BATCH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(BATCH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define BATCH_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define BATCH_TARGET_AVX2
+#endif
+
+// Power-basis coefficients of P(u,v) = sum C[a][b] u^a v^b, split per component (index a*4+b)
+struct BatchCoeffs {
+    float x[16], y[16], z[16];
+};
+
+// SoA output; normals may be null to skip them
+struct BatchOut {
+    float* x; float* y; float* z;
+    float* nx; float* ny; float* nz;
+};
+
+enum BatchKernel { BATCH_SCALAR = 0, BATCH_SSE2 = 1, BATCH_AVX2 = 2 };
+
+// aos points at 16 consecutive xyz triples, e.g. &powerCoeffs[0][0].x
+static inline void batchLoadCoeffs(BatchCoeffs& c, const float* aos) {
+    for (int k = 0; k < 16; k++) {
+        c.x[k] = aos[k * 3];
+        c.y[k] = aos[k * 3 + 1];
+        c.z[k] = aos[k * 3 + 2];
+    }
+}
+
+static inline BatchKernel batchDetectKernel() {
+#if defined(BATCH_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool fma = (info[2] & (1 << 12)) != 0;
+        bool avxOs = osxsave && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        if (avxOs && avx2 && fma) return BATCH_AVX2;
+    }
+    return BATCH_SSE2;
+#elif defined(BATCH_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return BATCH_AVX2;
+    if (__builtin_cpu_supports("sse2")) return BATCH_SSE2;
+    return BATCH_SCALAR;
+#else
+    return BATCH_SCALAR;
+#endif
+}
+
+static inline const char* batchKernelName(BatchKernel k) {
+    return k == BATCH_AVX2 ? "avx2" : (k == BATCH_SSE2 ? "sse2" : "scalar");
+}
+
+// Per-row polynomials in u: P = sum r[a] u^a, dP/dv = sum rv[a] u^a
+struct BatchRow {
+    float rx[4], ry[4], rz[4];
+    float rvx[4], rvy[4], rvz[4];
+};
+
+static inline void batchSetupRow(const BatchCoeffs& c, float v, BatchRow& r) {
+    float V[4] = { 1.0f, v, v * v, v * v * v };
+    float dV[4] = { 0.0f, 1.0f, 2.0f * v, 3.0f * v * v };
+    for (int a = 0; a < 4; a++) {
+        r.rx[a] = r.ry[a] = r.rz[a] = 0.0f;
+        r.rvx[a] = r.rvy[a] = r.rvz[a] = 0.0f;
+        for (int b = 0; b < 4; b++) {
+            r.rx[a] += c.x[a * 4 + b] * V[b];
+            r.ry[a] += c.y[a * 4 + b] * V[b];
+            r.rz[a] += c.z[a * 4 + b] * V[b];
+            r.rvx[a] += c.x[a * 4 + b] * dV[b];
+            r.rvy[a] += c.y[a * 4 + b] * dV[b];
+            r.rvz[a] += c.z[a * 4 + b] * dV[b];
+        }
+    }
+}
+
+static inline void batchRowScalar(const BatchRow& r, const float* us, size_t begin, size_t count,
+    const BatchOut& out, size_t offset) {
+    for (size_t i = begin; i < count; i++) {
+        float u = us[i];
+        size_t k = offset + i;
+        out.x[k] = ((r.rx[3] * u + r.rx[2]) * u + r.rx[1]) * u + r.rx[0];
+        out.y[k] = ((r.ry[3] * u + r.ry[2]) * u + r.ry[1]) * u + r.ry[0];
+        out.z[k] = ((r.rz[3] * u + r.rz[2]) * u + r.rz[1]) * u + r.rz[0];
+        if (!out.nx) continue;
+        float pux = (3.0f * r.rx[3] * u + 2.0f * r.rx[2]) * u + r.rx[1];
+        float puy = (3.0f * r.ry[3] * u + 2.0f * r.ry[2]) * u + r.ry[1];
+        float puz = (3.0f * r.rz[3] * u + 2.0f * r.rz[2]) * u + r.rz[1];
+        float pvx = ((r.rvx[3] * u + r.rvx[2]) * u + r.rvx[1]) * u + r.rvx[0];
+        float pvy = ((r.rvy[3] * u + r.rvy[2]) * u + r.rvy[1]) * u + r.rvy[0];
+        float pvz = ((r.rvz[3] * u + r.rvz[2]) * u + r.rvz[1]) * u + r.rvz[0];
+        float nx = puy * pvz - puz * pvy;
+        float ny = puz * pvx - pux * pvz;
+        float nz = pux * pvy - puy * pvx;
+        float inv = 1.0f / sqrtf(fmaxf(nx * nx + ny * ny + nz * nz, 1e-24f));
+        out.nx[k] = nx * inv;
+        out.ny[k] = ny * inv;
+        out.nz[k] = nz * inv;
+    }
+}
+
+#ifdef BATCH_X86
+static inline size_t batchRowSSE2(const BatchRow& r, const float* us, size_t count,
+    const BatchOut& out, size_t offset) {
+    size_t i = 0;
+    const __m128 three = _mm_set1_ps(3.0f), two = _mm_set1_ps(2.0f), tiny = _mm_set1_ps(1e-24f);
+    for (; i + 4 <= count; i += 4) {
+        __m128 u = _mm_loadu_ps(us + i);
+        size_t k = offset + i;
+#define BATCH_HORNER4(c) _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps( \
+            _mm_set1_ps(c[3]), u), _mm_set1_ps(c[2])), u), _mm_set1_ps(c[1])), u), _mm_set1_ps(c[0]))
+#define BATCH_DERIV4(c) _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(three, _mm_set1_ps(c[3])), u), \
+            _mm_mul_ps(two, _mm_set1_ps(c[2]))), u), _mm_set1_ps(c[1]))
+        _mm_storeu_ps(out.x + k, BATCH_HORNER4(r.rx));
+        _mm_storeu_ps(out.y + k, BATCH_HORNER4(r.ry));
+        _mm_storeu_ps(out.z + k, BATCH_HORNER4(r.rz));
+        if (!out.nx) continue;
+        __m128 pux = BATCH_DERIV4(r.rx), puy = BATCH_DERIV4(r.ry), puz = BATCH_DERIV4(r.rz);
+        __m128 pvx = BATCH_HORNER4(r.rvx), pvy = BATCH_HORNER4(r.rvy), pvz = BATCH_HORNER4(r.rvz);
+#undef BATCH_HORNER4
+#undef BATCH_DERIV4
+        __m128 nx = _mm_sub_ps(_mm_mul_ps(puy, pvz), _mm_mul_ps(puz, pvy));
+        __m128 ny = _mm_sub_ps(_mm_mul_ps(puz, pvx), _mm_mul_ps(pux, pvz));
+        __m128 nz = _mm_sub_ps(_mm_mul_ps(pux, pvy), _mm_mul_ps(puy, pvx));
+        __m128 l2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+        __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(l2, tiny)));
+        _mm_storeu_ps(out.nx + k, _mm_mul_ps(nx, inv));
+        _mm_storeu_ps(out.ny + k, _mm_mul_ps(ny, inv));
+        _mm_storeu_ps(out.nz + k, _mm_mul_ps(nz, inv));
+    }
+    return i;
+}
+
+BATCH_TARGET_AVX2
+static inline size_t batchRowAVX2(const BatchRow& r, const float* us, size_t count,
+    const BatchOut& out, size_t offset) {
+    size_t i = 0;
+    const __m256 three = _mm256_set1_ps(3.0f), two = _mm256_set1_ps(2.0f), tiny = _mm256_set1_ps(1e-24f);
+    for (; i + 8 <= count; i += 8) {
+        __m256 u = _mm256_loadu_ps(us + i);
+        size_t k = offset + i;
+#define BATCH_HORNER8(c) _mm256_fmadd_ps(_mm256_fmadd_ps(_mm256_fmadd_ps(_mm256_set1_ps(c[3]), u, \
+            _mm256_set1_ps(c[2])), u, _mm256_set1_ps(c[1])), u, _mm256_set1_ps(c[0]))
+#define BATCH_DERIV8(c) _mm256_fmadd_ps(_mm256_fmadd_ps(_mm256_mul_ps(three, _mm256_set1_ps(c[3])), u, \
+            _mm256_mul_ps(two, _mm256_set1_ps(c[2]))), u, _mm256_set1_ps(c[1]))
+        _mm256_storeu_ps(out.x + k, BATCH_HORNER8(r.rx));
+        _mm256_storeu_ps(out.y + k, BATCH_HORNER8(r.ry));
+        _mm256_storeu_ps(out.z + k, BATCH_HORNER8(r.rz));
+        if (!out.nx) continue;
+        __m256 pux = BATCH_DERIV8(r.rx), puy = BATCH_DERIV8(r.ry), puz = BATCH_DERIV8(r.rz);
+        __m256 pvx = BATCH_HORNER8(r.rvx), pvy = BATCH_HORNER8(r.rvy), pvz = BATCH_HORNER8(r.rvz);
+#undef BATCH_HORNER8
+#undef BATCH_DERIV8
+        __m256 nx = _mm256_fmsub_ps(puy, pvz, _mm256_mul_ps(puz, pvy));
+        __m256 ny = _mm256_fmsub_ps(puz, pvx, _mm256_mul_ps(pux, pvz));
+        __m256 nz = _mm256_fmsub_ps(pux, pvy, _mm256_mul_ps(puy, pvx));
+        __m256 l2 = _mm256_fmadd_ps(nz, nz, _mm256_fmadd_ps(ny, ny, _mm256_mul_ps(nx, nx)));
+        __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(_mm256_max_ps(l2, tiny)));
+        _mm256_storeu_ps(out.nx + k, _mm256_mul_ps(nx, inv));
+        _mm256_storeu_ps(out.ny + k, _mm256_mul_ps(ny, inv));
+        _mm256_storeu_ps(out.nz + k, _mm256_mul_ps(nz, inv));
+    }
+    return i;
+}
+#endif
+
+// Evaluate count samples (us[i], v) into out[offset + i]
+static inline void batchEvalRow(BatchKernel kernel, const BatchCoeffs& c, float v,
+    const float* us, size_t count, const BatchOut& out, size_t offset) {
+    BatchRow r;
+    batchSetupRow(c, v, r);
+    size_t done = 0;
+#ifdef BATCH_X86
+    if (kernel == BATCH_AVX2) done = batchRowAVX2(r, us, count, out, offset);
+    else if (kernel == BATCH_SSE2) done = batchRowSSE2(r, us, count, out, offset);
+#else
+    (void)kernel;
+#endif
+    batchRowScalar(r, us, done, count, out, offset);
+}
+
+// Evaluate a full nu x nv grid over [0,1]^2, out[j*nu + i]
+static inline void batchEvalGrid(BatchKernel kernel, const BatchCoeffs& c, int nu, int nv,
+    const BatchOut& out, float* usScratch) {
+    for (int i = 0; i < nu; i++) usScratch[i] = static_cast<float>(i) / static_cast<float>(nu - 1);
+    for (int j = 0; j < nv; j++) {
+        float v = static_cast<float>(j) / static_cast<float>(nv - 1);
+        batchEvalRow(kernel, c, v, usScratch, static_cast<size_t>(nu), out, static_cast<size_t>(j) * nu);
+    }
+}
+
+// Reusable SoA storage for one grid, resized in place between rebuilds
+struct BatchGrid {
+    std::vector<float> x, y, z, nx, ny, nz, us;
+    void resize(size_t count, size_t nu) {
+        x.resize(count); y.resize(count); z.resize(count);
+        nx.resize(count); ny.resize(count); nz.resize(count);
+        us.resize(nu);
+    }
+    BatchOut out() {
+        BatchOut o = { x.data(), y.data(), z.data(), nx.data(), ny.data(), nz.data() };
+        return o;
+    }
+};
+
+// Interleave SoA positions/normals into xyz triples (e.g. a Vec3 array) for GL vertex arrays
+static inline void batchGridToAoS(const BatchGrid& g, size_t count, float* pos, float* nrm) {
+    for (size_t k = 0; k < count; k++) {
+        pos[k * 3] = g.x[k]; pos[k * 3 + 1] = g.y[k]; pos[k * 3 + 2] = g.z[k];
+        nrm[k * 3] = g.nx[k]; nrm[k * 3 + 1] = g.ny[k]; nrm[k * 3 + 2] = g.nz[k];
+    }
+}
@@ -0,0 +1,246 @@
+// Tensor-product Bezier patches of any degree, fixed at compile time.
+// A net is a plain Vec3 array net[M][N] (degree M-1 in u, N-1 in v); the
+// functions deduce the degrees from the array type, use constexpr binomials and
+// unroll every loop over control points, so a bicubic evaluation is straight-line
+// code with no loop counters. Quadratic (3x3) and quintic (6x6) nets take the
+// same paths.
+#pragma once
+
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+struct Vec3 {
+    float x, y, z;
+    Vec3() : x(0), y(0), z(0) {}
+    Vec3(float X, float Y, float Z) : x(X), y(Y), z(Z) {}
+    Vec3 operator+(const Vec3& o) const { return Vec3(x + o.x, y + o.y, z + o.z); }
+    Vec3 operator-(const Vec3& o) const { return Vec3(x - o.x, y - o.y, z - o.z); }
+    Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
+};
+
+static inline Vec3 crossp(const Vec3& a, const Vec3& b) {
+    return Vec3(a.y * b.z - a.z * b.y,
+        a.z * b.x - a.x * b.z,
+        a.x * b.y - a.y * b.x);
+}
+static inline float dotp(const Vec3& a, const Vec3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+static inline float len(const Vec3& v) { return sqrtf(dotp(v, v)); }
+static inline Vec3 normalize(const Vec3& v) {
+    float L = len(v);
+    if (L == 0.0f) return Vec3(0, 0, 1);
+    return v * (1.0f / L);
+}
+
+constexpr int bezierBinomial(int n, int k) {
+    return (k < 0 || k > n) ? 0 : (k == 0 || k == n) ? 1 : bezierBinomial(n - 1, k - 1) + bezierBinomial(n - 1, k);
+}
+
+// Stirling numbers of the second kind; j! S(a, j) is the j-th forward difference of t^a at 0
+constexpr int bezierStirling2(int a, int j) {
+    return (a == 0 && j == 0) ? 1 : (a == 0 || j == 0) ? 0 : j * bezierStirling2(a - 1, j) + bezierStirling2(a - 1, j - 1);
+}
+
+constexpr int bezierFactorial(int n) { return n <= 1 ? 1 : n * bezierFactorial(n - 1); }
+
+// Bernstein -> power basis: B_i(t) = sum_a bezierPowerMatrix(n, a, i) t^a
+constexpr float bezierPowerMatrix(int n, int a, int i) {
+    return a < i ? 0.0f : static_cast<float>(bezierBinomial(n, i) * bezierBinomial(n - i, a - i) * ((a - i) % 2 ? -1 : 1));
+}
+
+// Per-degree constants, built by the compiler and indexed by unrolled (constant) indices
+template <int N>
+struct BezierTables {
+    float binom[N + 1];      // C(N, i)
+    float power[N + 1][N + 1]; // power[a][i] = bezierPowerMatrix(N, a, i)
+    float diff[N + 1][N + 1];  // diff[a][j] = j! S(a, j)
+    constexpr BezierTables() : binom(), power(), diff() {
+        for (int i = 0; i <= N; i++) binom[i] = static_cast<float>(bezierBinomial(N, i));
+        for (int a = 0; a <= N; a++)
+            for (int i = 0; i <= N; i++) {
+                power[a][i] = bezierPowerMatrix(N, a, i);
+                diff[a][i] = static_cast<float>(bezierFactorial(i) * bezierStirling2(a, i));
+            }
+    }
+};
+
+template <int N>
+struct BezierConst {
+    static constexpr BezierTables<N> t{};
+};
+
+// f(0), f(1), ..., f(N-1); each index is a std::integral_constant, so every call is
+// its own instantiation of f (called once, hence inlined) and index tests fold away
+template <class F, int... I>
+static inline void bezierUnroll(F&& f, std::integer_sequence<int, I...>) {
+    (void)f;
+    int expand[] = { 0, (f(std::integral_constant<int, I>()), 0)... };
+    (void)expand;
+}
+template <int N, class F>
+static inline void bezierUnroll(F&& f) {
+    bezierUnroll(f, std::make_integer_sequence<int, N>());
+}
+
+// t^0..t^N
+template <int N>
+static inline void bezierPowers(float t, float T[N + 1]) {
+    T[0] = 1.0f;
+    bezierUnroll<N>([&](auto a) { T[a + 1] = T[a] * t; });
+}
+
+// Bernstein basis of degree N: B[i] = C(N, i) t^i (1-t)^(N-i)
+template <int N>
+static inline void bernstein(float t, float B[N + 1]) {
+    float T[N + 1], S[N + 1];
+    bezierPowers<N>(t, T);
+    bezierPowers<N>(1.0f - t, S);
+    bezierUnroll<N + 1>([&](auto i) { B[i] = BezierConst<N>::t.binom[i] * T[i] * S[N - i]; });
+}
+
+// dB[i]/dt = N (B'[i-1] - B'[i]) with B' the basis of degree N-1
+template <int N>
+static inline void bernsteinDeriv(float t, float dB[N + 1]) {
+    float B[N + 1];
+    bernstein<N - 1>(t, B);
+    B[N] = 0.0f;
+    dB[0] = -N * B[0];
+    bezierUnroll<N>([&](auto i) { dB[i + 1] = N * (B[i] - B[i + 1]); });
+}
+
+// P(u, v) summed straight from the net
+template <int M, int N>
+static inline Vec3 bezierEval(const Vec3 (&net)[M][N], float u, float v) {
+    float Bu[M], Bv[N];
+    bernstein<M - 1>(u, Bu);
+    bernstein<N - 1>(v, Bv);
+    Vec3 P;
+    bezierUnroll<M>([&](auto i) {
+        Vec3 r;
+        bezierUnroll<N>([&](auto j) { r = r + net[i][j] * Bv[j]; });
+        P = P + r * Bu[i];
+    });
+    return P;
+}
+
+// Power-basis coefficients C[a][b] of P(u,v) = sum C[a][b] u^a v^b (C = Mu * net * Mv^T)
+template <int M, int N>
+static inline void bezierToPower(const Vec3 (&net)[M][N], Vec3 (&C)[M][N]) {
+    Vec3 T[M][N];
+    bezierUnroll<M>([&](auto a) {
+        bezierUnroll<N>([&](auto j) {
+            Vec3 s;
+            bezierUnroll<M>([&](auto i) { if (i <= a) s = s + net[i][j] * BezierConst<M - 1>::t.power[a][i]; });
+            T[a][j] = s;
+        });
+    });
+    bezierUnroll<M>([&](auto a) {
+        bezierUnroll<N>([&](auto b) {
+            Vec3 s;
+            bezierUnroll<N>([&](auto j) { if (j <= b) s = s + T[a][j] * BezierConst<N - 1>::t.power[b][j]; });
+            C[a][b] = s;
+        });
+    });
+}
+
+struct PatchEval {
+    Vec3 P, Pu, Pv;
+    Vec3 Puu, Puv, Pvv; // only filled when second derivatives are requested
+};
+
+// P, dP/du, dP/dv (and optionally second derivatives) in one pass over power coefficients
+template <int M, int N>
+static inline void bezierEvalPower(const Vec3 (&C)[M][N], float u, float v, PatchEval& e, bool second = false) {
+    float U[M + 1], V[N + 1];
+    bezierPowers<M>(u, U);
+    bezierPowers<N>(v, V);
+    e.P = e.Pu = e.Pv = Vec3();
+    if (second) e.Puu = e.Puv = e.Pvv = Vec3();
+    bezierUnroll<M>([&](auto a) {
+        Vec3 r, rv, rvv;
+        bezierUnroll<N>([&](auto b) {
+            r = r + C[a][b] * V[b];
+            if (b > 0) rv = rv + C[a][b] * (b * V[b - 1]);
+            if (second && b > 1) rvv = rvv + C[a][b] * (b * (b - 1) * V[b - 2]);
+        });
+        float dU = a > 0 ? a * U[a - 1] : 0.0f;
+        e.P = e.P + r * U[a];
+        e.Pu = e.Pu + r * dU;
+        e.Pv = e.Pv + rv * U[a];
+        if (second) {
+            float ddU = a > 1 ? a * (a - 1) * U[a - 2] : 0.0f;
+            e.Puu = e.Puu + r * ddU;
+            e.Puv = e.Puv + rv * dU;
+            e.Pvv = e.Pvv + rvv * U[a];
+        }
+    });
+}
+
+// Forward differencing of one Bezier curve of degree N sampled with step h.
+// Each step costs N vector additions instead of a full basis evaluation.
+template <int N>
+struct FwdDiff {
+    Vec3 d[N + 1]; // d[0] = f(t), d[j] = j-th forward difference
+
+    void init(const Vec3 (&p)[N + 1], float h) {
+        float H[N + 1];
+        bezierPowers<N>(h, H);
+        bezierUnroll<N + 1>([&](auto j) { d[j] = Vec3(); });
+        bezierUnroll<N + 1>([&](auto a) {
+            // power coefficient of t^a, scaled by h^a
+            Vec3 c;
+            bezierUnroll<N + 1>([&](auto i) { if (i <= a) c = c + p[i] * BezierConst<N>::t.power[a][i]; });
+            c = c * H[a];
+            bezierUnroll<N + 1>([&](auto j) {
+                if (j <= a) d[j] = d[j] + c * BezierConst<N>::t.diff[a][j];
+            });
+        });
+    }
+    const Vec3& value() const { return d[0]; }
+    void step() { bezierUnroll<N>([&](auto j) { d[j] = d[j] + d[j + 1]; }); }
+};
+
+// Sample a net on a (steps+1)x(steps+1) grid, out[v*(steps+1)+u].
+// The curves net[i][*] are stepped in v; each row is then a curve in u
+// whose control points are the current values of those curves.
+template <int M, int N>
+static inline void forwardDiffGrid(const Vec3 (&net)[M][N], int steps, Vec3* out) {
+    float h = 1.0f / static_cast<float>(steps);
+    FwdDiff<N - 1> col[M];
+    bezierUnroll<M>([&](auto i) { col[i].init(net[i], h); });
+    for (int v = 0; v <= steps; v++) {
+        Vec3 p[M];
+        bezierUnroll<M>([&](auto i) { p[i] = col[i].value(); });
+        FwdDiff<M - 1> row;
+        row.init(p, h);
+        Vec3* dst = out + static_cast<size_t>(v) * (steps + 1);
+        dst[0] = row.value();
+        for (int u = 1; u <= steps; u++) {
+            row.step();
+            dst[u] = row.value();
+        }
+        bezierUnroll<M>([&](auto i) { col[i].step(); });
+    }
+}
+
+// dP/du and dP/dv nets, degree-elevated back to MxN so forwardDiffGrid applies
+template <int M, int N>
+static inline void derivativeNets(const Vec3 (&net)[M][N], Vec3 (&du)[M][N], Vec3 (&dv)[M][N]) {
+    const float nu = static_cast<float>(M - 1), nv = static_cast<float>(N - 1);
+    bezierUnroll<N>([&](auto j) {
+        Vec3 q[M - 1];
+        bezierUnroll<M - 1>([&](auto i) { q[i] = (net[i + 1][j] - net[i][j]) * nu; });
+        du[0][j] = q[0];
+        du[M - 1][j] = q[M - 2];
+        bezierUnroll<M - 2>([&](auto i) { du[i + 1][j] = q[i] * ((i + 1) / nu) + q[i + 1] * (1.0f - (i + 1) / nu); });
+    });
+    bezierUnroll<M>([&](auto i) {
+        Vec3 q[N - 1];
+        bezierUnroll<N - 1>([&](auto j) { q[j] = (net[i][j + 1] - net[i][j]) * nv; });
+        dv[i][0] = q[0];
+        dv[i][N - 1] = q[N - 2];
+        bezierUnroll<N - 2>([&](auto j) { dv[i][j + 1] = q[j] * ((j + 1) / nv) + q[j + 1] * (1.0f - (j + 1) / nv); });
+    });
+}
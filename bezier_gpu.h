@@ -0,0 +1,122 @@
+// Bicubic patch evaluated in the vertex shader.
+// A static grid of (u, v) pairs and its triangle indices live in buffer objects
+// and change only with the resolution; the 16 control points are a uniform
+// array, so editing one costs a glUniform3fv instead of a re-tessellation.
+// The shader computes position, analytic normal (Pu x Pv) and texcoord; each
+// viewer supplies its lighting as a GLSL function `vec4 shade(vec3 P, vec3 N)`
+// (object space) and its fragment shader.
+#pragma once
+
+#include <string>
+#include <vector>
+#include "gl_ext.h"
+
+struct GpuPatch {
+    GLuint program = 0;
+    GLuint gridVbo = 0, gridIbo = 0;
+    GLint ctrlLoc = -1;
+    int samples = 0;        // grid points per side in the buffers
+    GLsizei indexCount = 0;
+    bool tried = false;     // init is not retried after a failure
+};
+
+static const char* gpuPatchVS =
+    "#version 120\n"
+    "attribute vec2 uv;\n"
+    "uniform vec3 ctrl[16]; // ctrl[i * 4 + j], i along u\n"
+    "vec4 shade(vec3 P, vec3 N);\n"
+    "void bernstein3(float t, out vec4 B, out vec4 D) {\n"
+    "    float s = 1.0 - t;\n"
+    "    B = vec4(s * s * s, 3.0 * t * s * s, 3.0 * t * t * s, t * t * t);\n"
+    "    D = vec4(-3.0 * s * s, 3.0 * s * s - 6.0 * t * s, 6.0 * t * s - 3.0 * t * t, 3.0 * t * t);\n"
+    "}\n"
+    "void main() {\n"
+    "    vec4 Bu, Du, Bv, Dv;\n"
+    "    bernstein3(uv.x, Bu, Du);\n"
+    "    bernstein3(uv.y, Bv, Dv);\n"
+    "    vec3 P = vec3(0.0), Pu = vec3(0.0), Pv = vec3(0.0);\n"
+    "    for (int i = 0; i < 4; i++) {\n"
+    "        vec3 r = ctrl[i * 4] * Bv.x + ctrl[i * 4 + 1] * Bv.y + ctrl[i * 4 + 2] * Bv.z + ctrl[i * 4 + 3] * Bv.w;\n"
+    "        vec3 rv = ctrl[i * 4] * Dv.x + ctrl[i * 4 + 1] * Dv.y + ctrl[i * 4 + 2] * Dv.z + ctrl[i * 4 + 3] * Dv.w;\n"
+    "        P += r * Bu[i];\n"
+    "        Pu += r * Du[i];\n"
+    "        Pv += rv * Bu[i];\n"
+    "    }\n"
+    "    vec3 N = cross(Pu, Pv);\n"
+    "    float L = length(N);\n"
+    "    N = L > 0.0 ? N / L : vec3(0.0, 0.0, 1.0);\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(P, 1.0);\n"
+    "    gl_TexCoord[0] = vec4(uv, 0.0, 1.0);\n"
+    "    gl_FrontColor = shade(P, N);\n"
+    "}\n";
+
+// Needs GLSL 1.20 and buffer objects; call with a current context. Returns false
+// (after saying why, once) when the path is unavailable.
+static inline bool gpuPatchInit(GpuPatch& gp, const char* shadeSource, const char* fsSource) {
+    if (gp.tried) return gp.program != 0;
+    gp.tried = true;
+    const GLExt& gl = glExtInit();
+    if (!gl.glsl || !gl.vbo) {
+        fprintf(stderr, "GPU patch evaluation needs GLSL 1.20 and buffer objects\n");
+        return false;
+    }
+    std::string vs = std::string(gpuPatchVS) + shadeSource;
+    static const char* attribs[] = { "uv", nullptr };
+    gp.program = glExtBuildProgram(vs.c_str(), fsSource, attribs);
+    if (!gp.program) return false;
+    gp.ctrlLoc = gl.GetUniformLocation(gp.program, "ctrl");
+    gl.GenBuffers(1, &gp.gridVbo);
+    gl.GenBuffers(1, &gp.gridIbo);
+    return true;
+}
+
+// (u, v) grid with samples x samples points, triangulated like the CPU meshes
+static inline void gpuPatchSetGrid(GpuPatch& gp, int samples) {
+    if (gp.samples == samples) return;
+    const GLExt& gl = glExt;
+    int n = samples - 1;
+    std::vector<float> uv(static_cast<size_t>(samples) * samples * 2);
+    for (int j = 0; j < samples; j++)
+        for (int i = 0; i < samples; i++) {
+            size_t k = static_cast<size_t>(j) * samples + i;
+            uv[k * 2] = static_cast<float>(i) / n;
+            uv[k * 2 + 1] = static_cast<float>(j) / n;
+        }
+    std::vector<GLuint> idx;
+    idx.reserve(static_cast<size_t>(n) * n * 6);
+    for (int j = 0; j < n; j++)
+        for (int i = 0; i < n; i++) {
+            GLuint i00 = j * samples + i, i10 = i00 + 1;
+            GLuint i01 = i00 + samples, i11 = i01 + 1;
+            idx.push_back(i00); idx.push_back(i10); idx.push_back(i11);
+            idx.push_back(i00); idx.push_back(i11); idx.push_back(i01);
+        }
+    gl.BindBuffer(GL_ARRAY_BUFFER, gp.gridVbo);
+    gl.BufferData(GL_ARRAY_BUFFER, uv.size() * sizeof(float), uv.data(), GL_STATIC_DRAW);
+    gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, gp.gridIbo);
+    gl.BufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(GLuint), idx.data(), GL_STATIC_DRAW);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    gp.samples = samples;
+    gp.indexCount = static_cast<GLsizei>(idx.size());
+}
+
+// Makes the program current and uploads the net (16 xyz triples, ctrl[i][j] order);
+// set any shading uniforms after this, then call gpuPatchDraw
+static inline void gpuPatchBind(const GpuPatch& gp, const float* ctrlXyz) {
+    glExt.UseProgram(gp.program);
+    glExt.Uniform3fv(gp.ctrlLoc, 16, ctrlXyz);
+}
+
+static inline void gpuPatchDraw(const GpuPatch& gp) {
+    const GLExt& gl = glExt;
+    gl.BindBuffer(GL_ARRAY_BUFFER, gp.gridVbo);
+    gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, gp.gridIbo);
+    gl.EnableVertexAttribArray(0);
+    gl.VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glDrawElements(GL_TRIANGLES, gp.indexCount, GL_UNSIGNED_INT, nullptr);
+    gl.DisableVertexAttribArray(0);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    gl.UseProgram(0);
+}
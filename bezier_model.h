@@ -0,0 +1,320 @@
+// Multi-patch bicubic models (.bpt) and parallel tessellation on a work-stealing pool.
+// Every patch owns a fixed slice of the shared vertex/index buffers, so workers
+// never contend on output and the result does not depend on scheduling.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bezier_batch.h"
+
+// One bicubic control net, xyz per point, index (i*4+j)*3 with i along u, j along v
+struct BezierNet {
+    float p[48];
+};
+
+struct BezierModel {
+    std::vector<BezierNet> patches;
+};
+
+// .bpt: patch count, then per patch a "3 3" degree line and 16 points (rows of v, u fastest)
+static inline bool loadBptModel(const char* fname, BezierModel& model) {
+    std::ifstream in(fname);
+    if (!in.is_open()) return false;
+    int count = 0;
+    if (!(in >> count) || count <= 0) return false;
+    std::vector<BezierNet> patches(static_cast<size_t>(count));
+    for (int p = 0; p < count; p++) {
+        int du = 0, dv = 0;
+        if (!(in >> du >> dv)) return false;
+        if (du != 3 || dv != 3) {
+            fprintf(stderr, "%s: patch %d has degree %dx%d, only bicubic is supported\n", fname, p, du, dv);
+            return false;
+        }
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++) {
+                float* dst = &patches[p].p[(c * 4 + r) * 3];
+                if (!(in >> dst[0] >> dst[1] >> dst[2])) return false;
+            }
+    }
+    model.patches.swap(patches);
+    return true;
+}
+
+// Newell's teapot (z up, spout towards +x), as stored by GLUT: ten patches cover one
+// quarter of the rim, body, lid and bottom and one half of the handle and spout; the
+// other 22 are mirror images. Mirrored copies reverse u so every normal points outward.
+static inline void teapotModel(BezierModel& model) {
+    static const float points[129][3] = {
+        { 1.4f, 0, 2.4f }, { 1.4f, -0.784f, 2.4f }, { 0.784f, -1.4f, 2.4f }, { 0, -1.4f, 2.4f },
+        { 1.3375f, 0, 2.53125f }, { 1.3375f, -0.749f, 2.53125f }, { 0.749f, -1.3375f, 2.53125f }, { 0, -1.3375f, 2.53125f },
+        { 1.4375f, 0, 2.53125f }, { 1.4375f, -0.805f, 2.53125f }, { 0.805f, -1.4375f, 2.53125f }, { 0, -1.4375f, 2.53125f },
+        { 1.5f, 0, 2.4f }, { 1.5f, -0.84f, 2.4f }, { 0.84f, -1.5f, 2.4f }, { 0, -1.5f, 2.4f },
+        { 1.75f, 0, 1.875f }, { 1.75f, -0.98f, 1.875f }, { 0.98f, -1.75f, 1.875f }, { 0, -1.75f, 1.875f },
+        { 2, 0, 1.35f }, { 2, -1.12f, 1.35f }, { 1.12f, -2, 1.35f }, { 0, -2, 1.35f },
+        { 2, 0, 0.9f }, { 2, -1.12f, 0.9f }, { 1.12f, -2, 0.9f }, { 0, -2, 0.9f },
+        { 2, 0, 0.45f }, { 2, -1.12f, 0.45f }, { 1.12f, -2, 0.45f }, { 0, -2, 0.45f },
+        { 1.5f, 0, 0.225f }, { 1.5f, -0.84f, 0.225f }, { 0.84f, -1.5f, 0.225f }, { 0, -1.5f, 0.225f },
+        { 1.5f, 0, 0.15f }, { 1.5f, -0.84f, 0.15f }, { 0.84f, -1.5f, 0.15f }, { 0, -1.5f, 0.15f },
+        { 0, 0, 3.15f }, { 0, -0.002f, 3.15f }, { 0.002f, 0, 3.15f }, { 0.8f, 0, 3.15f },
+        { 0.8f, -0.45f, 3.15f }, { 0.45f, -0.8f, 3.15f }, { 0, -0.8f, 3.15f }, { 0, 0, 2.85f },
+        { 0.2f, 0, 2.7f }, { 0.2f, -0.112f, 2.7f }, { 0.112f, -0.2f, 2.7f }, { 0, -0.2f, 2.7f },
+        { 0.4f, 0, 2.55f }, { 0.4f, -0.224f, 2.55f }, { 0.224f, -0.4f, 2.55f }, { 0, -0.4f, 2.55f },
+        { 1.3f, 0, 2.55f }, { 1.3f, -0.728f, 2.55f }, { 0.728f, -1.3f, 2.55f }, { 0, -1.3f, 2.55f },
+        { 1.3f, 0, 2.4f }, { 1.3f, -0.728f, 2.4f }, { 0.728f, -1.3f, 2.4f }, { 0, -1.3f, 2.4f },
+        { 0, 0, 0 }, { 0, -1.425f, 0 }, { 0.798f, -1.425f, 0 }, { 1.425f, -0.798f, 0 },
+        { 1.425f, 0, 0 }, { 0, -1.5f, 0.075f }, { 0.84f, -1.5f, 0.075f }, { 1.5f, -0.84f, 0.075f },
+        { 1.5f, 0, 0.075f }, { -1.6f, 0, 2.025f }, { -1.6f, -0.3f, 2.025f }, { -1.5f, -0.3f, 2.25f },
+        { -1.5f, 0, 2.25f }, { -2.3f, 0, 2.025f }, { -2.3f, -0.3f, 2.025f }, { -2.5f, -0.3f, 2.25f },
+        { -2.5f, 0, 2.25f }, { -2.7f, 0, 2.025f }, { -2.7f, -0.3f, 2.025f }, { -3, -0.3f, 2.25f },
+        { -3, 0, 2.25f }, { -2.7f, 0, 1.8f }, { -2.7f, -0.3f, 1.8f }, { -3, -0.3f, 1.8f },
+        { -3, 0, 1.8f }, { -2.7f, 0, 1.575f }, { -2.7f, -0.3f, 1.575f }, { -3, -0.3f, 1.35f },
+        { -3, 0, 1.35f }, { -2.5f, 0, 1.125f }, { -2.5f, -0.3f, 1.125f }, { -2.65f, -0.3f, 0.9375f },
+        { -2.65f, 0, 0.9375f }, { -2, 0, 0.9f }, { -2, -0.3f, 0.9f }, { -1.9f, -0.3f, 0.6f },
+        { -1.9f, 0, 0.6f }, { 1.7f, 0, 1.425f }, { 1.7f, -0.66f, 1.425f }, { 1.7f, -0.66f, 0.6f },
+        { 1.7f, 0, 0.6f }, { 2.6f, 0, 1.425f }, { 2.6f, -0.66f, 1.425f }, { 3.1f, -0.66f, 0.825f },
+        { 3.1f, 0, 0.825f }, { 2.3f, 0, 2.1f }, { 2.3f, -0.25f, 2.1f }, { 2.4f, -0.25f, 2.025f },
+        { 2.4f, 0, 2.025f }, { 2.7f, 0, 2.4f }, { 2.7f, -0.25f, 2.4f }, { 3.3f, -0.25f, 2.4f },
+        { 3.3f, 0, 2.4f }, { 2.8f, 0, 2.475f }, { 2.8f, -0.25f, 2.475f }, { 3.525f, -0.25f, 2.49375f },
+        { 3.525f, 0, 2.49375f }, { 2.9f, 0, 2.475f }, { 2.9f, -0.15f, 2.475f }, { 3.45f, -0.15f, 2.5125f },
+        { 3.45f, 0, 2.5125f }, { 2.8f, 0, 2.4f }, { 2.8f, -0.15f, 2.4f }, { 3.2f, -0.15f, 2.4f },
+        { 3.2f, 0, 2.4f }
+    };
+    static const int patches[10][16] = {
+        {   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15 },
+        {  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27 },
+        {  24,  25,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39 },
+        {  40,  41,  42,  40,  43,  44,  45,  46,  47,  47,  47,  47,  48,  49,  50,  51 },
+        {  48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63 },
+        {  64,  64,  64,  64,  65,  66,  67,  68,  69,  70,  71,  72,  39,  38,  37,  36 },
+        {  73,  74,  75,  76,  77,  78,  79,  80,  81,  82,  83,  84,  85,  86,  87,  88 },
+        {  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95,  96,  97,  98,  99, 100 },
+        { 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111, 112, 113, 114, 115, 116 },
+        { 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127, 128 }
+    };
+    static const float mirror[4][2] = { { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+    model.patches.clear();
+    for (int p = 0; p < 10; p++) {
+        int copies = p < 6 ? 4 : 2; // rim, body, lid, bottom : handle, spout (mirrored in y only)
+        for (int m = 0; m < copies; m++) {
+            float sx = mirror[m][0], sy = mirror[m][1];
+            bool flip = sx * sy < 0.0f;
+            BezierNet net;
+            for (int r = 0; r < 4; r++)
+                for (int c = 0; c < 4; c++) {
+                    const float* q = points[patches[p][r * 4 + c]];
+                    float* dst = &net.p[((flip ? 3 - c : c) * 4 + r) * 3];
+                    dst[0] = q[0] * sx;
+                    dst[1] = q[1] * sy;
+                    dst[2] = q[2];
+                }
+            model.patches.push_back(net);
+        }
+    }
+}
+
+// Power-basis coefficients of one net (C = M * G * M^T)
+static inline void batchCoeffsFromNet(const BezierNet& net, BatchCoeffs& c) {
+    static const float M[4][4] = {
+        { 1,  0,  0, 0},
+        {-3,  3,  0, 0},
+        { 3, -6,  3, 0},
+        {-1,  3, -3, 1}
+    };
+    float aos[48];
+    for (int k = 0; k < 3; k++) {
+        float T[4][4];
+        for (int a = 0; a < 4; a++)
+            for (int j = 0; j < 4; j++) {
+                float s = 0.0f;
+                for (int i = 0; i < 4; i++) s += M[a][i] * net.p[(i * 4 + j) * 3 + k];
+                T[a][j] = s;
+            }
+        for (int a = 0; a < 4; a++)
+            for (int b = 0; b < 4; b++) {
+                float s = 0.0f;
+                for (int j = 0; j < 4; j++) s += T[a][j] * M[b][j];
+                aos[(a * 4 + b) * 3 + k] = s;
+            }
+    }
+    batchLoadCoeffs(c, aos);
+}
+
+// Persistent workers plus the calling thread. parallelFor() hands each worker a
+// contiguous index range; a worker that runs dry steals the back half of another's.
+// Range state is one packed 64-bit word (begin low, end high) so owner pops and
+// thief splits are both a single CAS.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads = 0) {
+        if (threads == 0) threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+        ranges_ = std::vector<Range>(threads);
+        for (unsigned w = 1; w < threads; w++) workers_.emplace_back(&WorkStealingPool::workerLoop, this, w);
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+        }
+        wake_.notify_all();
+        for (size_t i = 0; i < workers_.size(); i++) workers_[i].join();
+    }
+
+    unsigned size() const { return static_cast<unsigned>(ranges_.size()); }
+    size_t steals() const { return steals_.load(); }
+
+    // Calls fn(index, worker) for every index in [0, count); returns when all are done
+    void parallelFor(size_t count, const std::function<void(size_t, unsigned)>& fn) {
+        if (count == 0) return;
+        unsigned n = size();
+        for (unsigned w = 0; w < n; w++) {
+            uint64_t b = count * w / n, e = count * (w + 1) / n;
+            ranges_[w].span.store(pack(b, e));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &fn;
+            pending_ = n - 1;
+            generation_++;
+        }
+        wake_.notify_all();
+        runWorker(0);
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return pending_ == 0; });
+        job_ = nullptr;
+    }
+
+private:
+    struct Range {
+        std::atomic<uint64_t> span;
+        Range() : span(0) {}
+        Range(const Range&) : span(0) {}
+    };
+
+    static uint64_t pack(uint64_t b, uint64_t e) { return b | (e << 32); }
+    static uint64_t lo(uint64_t s) { return s & 0xffffffffu; }
+    static uint64_t hi(uint64_t s) { return s >> 32; }
+
+    bool popOwn(unsigned w, size_t& index) {
+        uint64_t s = ranges_[w].span.load();
+        while (lo(s) < hi(s)) {
+            if (ranges_[w].span.compare_exchange_weak(s, pack(lo(s) + 1, hi(s)))) {
+                index = static_cast<size_t>(lo(s));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool stealInto(unsigned w) {
+        unsigned n = size();
+        for (unsigned k = 1; k < n; k++) {
+            unsigned victim = (w + k) % n;
+            uint64_t s = ranges_[victim].span.load();
+            while (lo(s) < hi(s)) {
+                uint64_t mid = lo(s) + (hi(s) - lo(s)) / 2;
+                if (ranges_[victim].span.compare_exchange_weak(s, pack(lo(s), mid))) {
+                    ranges_[w].span.store(pack(mid, hi(s)));
+                    steals_++;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void runWorker(unsigned w) {
+        const std::function<void(size_t, unsigned)>& fn = *job_;
+        size_t index;
+        for (;;) {
+            while (popOwn(w, index)) fn(index, w);
+            if (!stealInto(w)) break;
+        }
+    }
+
+    void workerLoop(unsigned w) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return quit_ || generation_ != seen; });
+                if (quit_) return;
+                seen = generation_;
+            }
+            runWorker(w);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) done_.notify_one();
+        }
+    }
+
+    std::vector<Range> ranges_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    const std::function<void(size_t, unsigned)>* job_ = nullptr;
+    uint64_t generation_ = 0;
+    unsigned pending_ = 0;
+    bool quit_ = false;
+    std::atomic<size_t> steals_{ 0 };
+};
+
+// Shared output buffers for a tessellated model, resized in place between rebuilds
+struct ModelMesh {
+    std::vector<float> pos, nrm, uv; // xyz, xyz, uv per vertex
+    std::vector<uint32_t> idx;
+    std::vector<BatchGrid> scratch; // one per pool worker
+    int res = 0;              // samples per patch side
+    size_t patchCount = 0;
+};
+
+// Tessellate every patch on an N x N grid in parallel. Patch p writes vertices
+// [p*N*N, (p+1)*N*N) and indices [p*(N-1)^2*6, ...), so slices never overlap.
+static inline void tessellateModel(const BezierModel& model, int N, BatchKernel kernel,
+    WorkStealingPool& pool, ModelMesh& mesh) {
+    size_t perPatchVerts = static_cast<size_t>(N) * N;
+    size_t perPatchIdx = static_cast<size_t>(N - 1) * (N - 1) * 6;
+    size_t patches = model.patches.size();
+    bool rebuildIdx = mesh.res != N || mesh.patchCount != patches;
+    mesh.pos.resize(patches * perPatchVerts * 3);
+    mesh.nrm.resize(patches * perPatchVerts * 3);
+    mesh.uv.resize(patches * perPatchVerts * 2);
+    mesh.idx.resize(patches * perPatchIdx);
+
+    mesh.scratch.resize(pool.size());
+    pool.parallelFor(patches, [&](size_t p, unsigned worker) {
+        BatchGrid& g = mesh.scratch[worker];
+        g.resize(perPatchVerts, static_cast<size_t>(N));
+        BatchCoeffs c;
+        batchCoeffsFromNet(model.patches[p], c);
+        batchEvalGrid(kernel, c, N, N, g.out(), g.us.data());
+
+        size_t base = p * perPatchVerts;
+        batchGridToAoS(g, perPatchVerts, &mesh.pos[base * 3], &mesh.nrm[base * 3]);
+        float* uv = &mesh.uv[base * 2];
+        for (int j = 0; j < N; j++)
+            for (int i = 0; i < N; i++) {
+                uv[(j * N + i) * 2] = i / float(N - 1);
+                uv[(j * N + i) * 2 + 1] = j / float(N - 1);
+            }
+
+        if (!rebuildIdx) return;
+        uint32_t* idx = &mesh.idx[p * perPatchIdx];
+        for (int j = 0; j < N - 1; j++)
+            for (int i = 0; i < N - 1; i++) {
+                uint32_t i00 = static_cast<uint32_t>(base + j * N + i), i10 = i00 + 1;
+                uint32_t i01 = i00 + N, i11 = i01 + 1;
+                *idx++ = i00; *idx++ = i10; *idx++ = i11;
+                *idx++ = i00; *idx++ = i11; *idx++ = i01;
+            }
+    });
+    mesh.res = N;
+    mesh.patchCount = patches;
+}
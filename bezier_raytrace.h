@@ -0,0 +1,483 @@
+// Ray tracing of one bicubic patch, without tessellating it.
+// The net is split with de Casteljau into a binary hierarchy whose boxes bound
+// each sub-net's control points (convex hull), down to nearly flat leaves. Rays
+// walk it in 2x2 packets with one SSE slab test per box, and every leaf a ray
+// reaches seeds a Newton iteration on the exact surface from the leaf's (u, v)
+// centre, so silhouettes are as sharp as the pixel grid. Tiles of the image are
+// independent and run on the work-stealing pool; passes at decreasing pixel
+// steps give a progressive preview. The same hierarchy answers single-ray picks,
+// and RtModel puts a second one over the patches of a multi-patch model.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "bezier_core.h"
+#include "bezier_model.h"
+
+struct RtNode {
+    float lo[3], hi[3];
+    int child = -1;           // first of two consecutive children, -1 for a leaf
+    float u0, u1, v0, v1;     // parameter range of the sub-net
+};
+
+struct RtPatch {
+    Vec3 net[4][4];           // the net the hierarchy was built from
+    Vec3 C[4][4];             // power-basis coefficients for the Newton steps
+    std::vector<RtNode> nodes;
+    float eps = 1e-6f;        // convergence distance, scaled to the patch size
+    int leaves = 0;
+    bool valid = false;
+};
+
+// Pinhole camera matching gluPerspective + gluLookAt
+struct RtCamera {
+    Vec3 pos, forward, right, up;
+    float tanHalfFov, aspect;
+    float zNear, zFar;
+};
+
+// Bottom-up rows, ready for glDrawPixels; depth is in window coordinates
+struct RtImage {
+    int w = 0, h = 0;
+    std::vector<unsigned char> rgb;
+    std::vector<float> depth;
+    RtCamera cam;
+    int step = 0;             // pixel step of the last finished pass; 1 when complete, 0 when empty
+};
+
+static const int rtFirstStep = 8;   // coarsest progressive pass
+static const int rtTile = 32;       // a multiple of 2 * rtFirstStep, so packets never cross tiles
+static const int rtMaxDepth = 12;
+static const float rtFlatness = 2e-3f; // leaf when the net is this close to bilinear, relative to the patch size
+
+static inline RtCamera rtLookAt(const Vec3& eye, const Vec3& center, const Vec3& up, float fovyDeg,
+    float aspect, float zNear, float zFar) {
+    RtCamera cam;
+    cam.pos = eye;
+    cam.forward = normalize(center - eye);
+    cam.right = normalize(crossp(cam.forward, up));
+    cam.up = crossp(cam.right, cam.forward);
+    cam.tanHalfFov = tanf(fovyDeg * 0.5f * 3.14159265f / 180.0f);
+    cam.aspect = aspect;
+    cam.zNear = zNear;
+    cam.zFar = zFar;
+    return cam;
+}
+
+// Split a net at t = 0.5 along u (i) or v (j)
+static inline void rtSplit(const Vec3 (&in)[4][4], Vec3 (&a)[4][4], Vec3 (&b)[4][4], bool alongU) {
+    for (int line = 0; line < 4; line++) {
+        Vec3 p[4];
+        for (int t = 0; t < 4; t++) p[t] = alongU ? in[t][line] : in[line][t];
+        Vec3 p01 = (p[0] + p[1]) * 0.5f, p12 = (p[1] + p[2]) * 0.5f, p23 = (p[2] + p[3]) * 0.5f;
+        Vec3 p012 = (p01 + p12) * 0.5f, p123 = (p12 + p23) * 0.5f;
+        Vec3 mid = (p012 + p123) * 0.5f;
+        Vec3 lo[4] = { p[0], p01, p012, mid };
+        Vec3 hi[4] = { mid, p123, p23, p[3] };
+        for (int t = 0; t < 4; t++) {
+            if (alongU) { a[t][line] = lo[t]; b[t][line] = hi[t]; }
+            else { a[line][t] = lo[t]; b[line][t] = hi[t]; }
+        }
+    }
+}
+
+// Largest distance of a control point from the bilinear patch through the corners
+static inline float rtFlatnessError(const Vec3 (&n)[4][4]) {
+    float worst = 0.0f;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++) {
+            float s = i / 3.0f, t = j / 3.0f;
+            Vec3 b = (n[0][0] * (1 - t) + n[0][3] * t) * (1 - s) + (n[3][0] * (1 - t) + n[3][3] * t) * s;
+            worst = std::max(worst, len(n[i][j] - b));
+        }
+    return worst;
+}
+
+static inline void rtBuildNode(RtPatch& rp, int index, const Vec3 (&n)[4][4], int depth, float tol) {
+    RtNode& node = rp.nodes[index];
+    for (int k = 0; k < 3; k++) { node.lo[k] = 1e30f; node.hi[k] = -1e30f; }
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++) {
+            const float* p = &n[i][j].x;
+            for (int k = 0; k < 3; k++) {
+                node.lo[k] = std::min(node.lo[k], p[k] - rp.eps);
+                node.hi[k] = std::max(node.hi[k], p[k] + rp.eps);
+            }
+        }
+    if (depth >= rtMaxDepth || rtFlatnessError(n) <= tol) {
+        rp.leaves++;
+        return;
+    }
+    // halve the parameter direction whose control polygon is longer
+    float lu = 0.0f, lv = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        lu += len(n[k + 1][0] - n[k][0]) + len(n[k + 1][3] - n[k][3]);
+        lv += len(n[0][k + 1] - n[0][k]) + len(n[3][k + 1] - n[3][k]);
+    }
+    bool alongU = lu >= lv;
+    Vec3 a[4][4], b[4][4];
+    rtSplit(n, a, b, alongU);
+    int child = static_cast<int>(rp.nodes.size());
+    RtNode lower = node, upper = node;
+    if (alongU) lower.u1 = upper.u0 = 0.5f * (node.u0 + node.u1);
+    else lower.v1 = upper.v0 = 0.5f * (node.v0 + node.v1);
+    rp.nodes[index].child = child;
+    rp.nodes.push_back(lower); // invalidates node
+    rp.nodes.push_back(upper);
+    rp.nodes[child].child = rp.nodes[child + 1].child = -1;
+    rtBuildNode(rp, child, a, depth + 1, tol);
+    rtBuildNode(rp, child + 1, b, depth + 1, tol);
+}
+
+static inline void rtBuild(RtPatch& rp, const Vec3 (&net)[4][4]) {
+    memcpy(rp.net, net, sizeof(rp.net));
+    bezierToPower(net, rp.C);
+    Vec3 lo = net[0][0], hi = net[0][0];
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++) {
+            const Vec3& p = net[i][j];
+            lo = Vec3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+            hi = Vec3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+        }
+    float size = std::max(len(hi - lo), 1e-6f);
+    rp.eps = 1e-5f * size;
+    rp.nodes.clear();
+    rp.nodes.resize(1);
+    RtNode& root = rp.nodes[0];
+    root.u0 = root.v0 = 0.0f;
+    root.u1 = root.v1 = 1.0f;
+    rp.leaves = 0;
+    rtBuildNode(rp, 0, net, 0, rtFlatness * size);
+    rp.valid = true;
+}
+
+static inline bool rtSameNet(const RtPatch& rp, const Vec3 (&net)[4][4]) {
+    return rp.valid && memcmp(rp.net, net, sizeof(rp.net)) == 0;
+}
+
+// Four rays in SoA form; the inverse directions feed the slab tests
+struct RtPacket {
+    alignas(16) float ox[4], oy[4], oz[4];
+    alignas(16) float dx[4], dy[4], dz[4];
+    alignas(16) float ix[4], iy[4], iz[4];
+    alignas(16) float t[4];       // nearest hit so far (the far limit while searching)
+    float u[4], v[4];
+    Vec3 N[4];                    // unnormalized Pu x Pv at the hit
+};
+
+// Lanes of `active` whose ray enters the box before its current hit
+static inline int rtBoxMask(const float lo[3], const float hi[3], const RtPacket& r, int active) {
+#ifdef BATCH_X86
+    __m128 t0 = _mm_setzero_ps(), t1 = _mm_load_ps(r.t);
+    const float* o[3] = { r.ox, r.oy, r.oz };
+    const float* inv[3] = { r.ix, r.iy, r.iz };
+    for (int k = 0; k < 3; k++) {
+        __m128 oo = _mm_load_ps(o[k]), ii = _mm_load_ps(inv[k]);
+        __m128 a = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(lo[k]), oo), ii);
+        __m128 b = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(hi[k]), oo), ii);
+        t0 = _mm_max_ps(t0, _mm_min_ps(a, b));
+        t1 = _mm_min_ps(t1, _mm_max_ps(a, b));
+    }
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1)) & active;
+#else
+    int mask = 0;
+    for (int l = 0; l < 4; l++) {
+        if (!(active & (1 << l))) continue;
+        float o[3] = { r.ox[l], r.oy[l], r.oz[l] };
+        float inv[3] = { r.ix[l], r.iy[l], r.iz[l] };
+        float t0 = 0.0f, t1 = r.t[l];
+        for (int k = 0; k < 3; k++) {
+            float a = (lo[k] - o[k]) * inv[k], b = (hi[k] - o[k]) * inv[k];
+            t0 = std::max(t0, std::min(a, b));
+            t1 = std::min(t1, std::max(a, b));
+        }
+        if (t0 <= t1) mask |= 1 << l;
+    }
+    return mask;
+#endif
+}
+
+// Newton on the ray written as two planes, seeded at the leaf centre. Keeps the
+// hit when it converges inside the leaf (with a small margin) and is the nearest so far.
+static inline void rtNewton(const RtPatch& rp, const RtNode& leaf, RtPacket& r, int l) {
+    Vec3 O(r.ox[l], r.oy[l], r.oz[l]), D(r.dx[l], r.dy[l], r.dz[l]);
+    Vec3 n1 = fabsf(D.x) > fabsf(D.y) && fabsf(D.x) > fabsf(D.z) ? Vec3(D.y, -D.x, 0.0f) : Vec3(0.0f, D.z, -D.y);
+    n1 = normalize(n1);
+    Vec3 n2 = normalize(crossp(n1, D));
+    float d1 = -dotp(n1, O), d2 = -dotp(n2, O);
+    float mu = 0.1f * (leaf.u1 - leaf.u0), mv = 0.1f * (leaf.v1 - leaf.v0);
+    float u = 0.5f * (leaf.u0 + leaf.u1), v = 0.5f * (leaf.v0 + leaf.v1);
+    PatchEval e;
+    for (int it = 0; it < 8; it++) {
+        bezierEvalPower(rp.C, u, v, e);
+        float f1 = dotp(n1, e.P) + d1, f2 = dotp(n2, e.P) + d2;
+        if (fabsf(f1) + fabsf(f2) < rp.eps) {
+            if (u < leaf.u0 - mu || u > leaf.u1 + mu || v < leaf.v0 - mv || v > leaf.v1 + mv) return;
+            if (u < 0.0f || u > 1.0f || v < 0.0f || v > 1.0f) return;
+            float t = dotp(e.P - O, D);
+            if (t <= 0.0f || t >= r.t[l]) return;
+            r.t[l] = t;
+            r.u[l] = u;
+            r.v[l] = v;
+            r.N[l] = crossp(e.Pu, e.Pv);
+            return;
+        }
+        float a = dotp(n1, e.Pu), b = dotp(n1, e.Pv), c = dotp(n2, e.Pu), d = dotp(n2, e.Pv);
+        float det = a * d - b * c;
+        if (det == 0.0f) return;
+        u -= (d * f1 - b * f2) / det;
+        v -= (a * f2 - c * f1) / det;
+        // wandered off this leaf: a neighbouring leaf owns that hit
+        if (fabsf(u - 0.5f * (leaf.u0 + leaf.u1)) > 2.0f * (leaf.u1 - leaf.u0)) return;
+        if (fabsf(v - 0.5f * (leaf.v0 + leaf.v1)) > 2.0f * (leaf.v1 - leaf.v0)) return;
+    }
+}
+
+// Nearest hits for the packet's active lanes; returns the lanes that hit
+static inline int rtTracePacket(const RtPatch& rp, RtPacket& r, int active) {
+    int stack[2 * rtMaxDepth + 2];
+    int top = 0;
+    stack[top++] = 0;
+    int hit = 0;
+    while (top > 0) {
+        const RtNode& node = rp.nodes[stack[--top]];
+        int mask = rtBoxMask(node.lo, node.hi, r, active);
+        if (!mask) continue;
+        if (node.child < 0) {
+            for (int l = 0; l < 4; l++) {
+                if (!(mask & (1 << l))) continue;
+                float before = r.t[l];
+                rtNewton(rp, node, r, l);
+                if (r.t[l] < before) hit |= 1 << l;
+            }
+            continue;
+        }
+        // nearer child on top, judged along the first active ray
+        int l = 0;
+        while (!(mask & (1 << l))) l++;
+        const RtNode& a = rp.nodes[node.child];
+        const RtNode& b = rp.nodes[node.child + 1];
+        const float* d[3] = { r.dx, r.dy, r.dz };
+        float ca = 0.0f, cb = 0.0f;
+        for (int ax = 0; ax < 3; ax++) {
+            ca += (a.lo[ax] + a.hi[ax]) * d[ax][l];
+            cb += (b.lo[ax] + b.hi[ax]) * d[ax][l];
+        }
+        if (ca <= cb) { stack[top++] = node.child + 1; stack[top++] = node.child; }
+        else { stack[top++] = node.child; stack[top++] = node.child + 1; }
+    }
+    return hit;
+}
+
+struct RtHit {
+    int patch = -1;           // index into RtModel::patches; 0 for a single patch
+    float t = 0.0f, u = 0.0f, v = 0.0f;
+    Vec3 P, N;                // N is the unit Pu x Pv
+};
+
+// Lane 0 carries the ray; the others copy it and stay inactive
+static inline void rtSingleRay(RtPacket& r, const Vec3& O, const Vec3& D, float tMax) {
+    for (int l = 0; l < 4; l++) {
+        r.ox[l] = O.x; r.oy[l] = O.y; r.oz[l] = O.z;
+        r.dx[l] = D.x; r.dy[l] = D.y; r.dz[l] = D.z;
+        r.ix[l] = 1.0f / D.x; r.iy[l] = 1.0f / D.y; r.iz[l] = 1.0f / D.z;
+        r.t[l] = tMax;
+    }
+}
+
+static inline void rtFillHit(const RtPacket& r, RtHit& hit) {
+    hit.t = r.t[0];
+    hit.u = r.u[0];
+    hit.v = r.v[0];
+    hit.P = Vec3(r.ox[0], r.oy[0], r.oz[0]) + Vec3(r.dx[0], r.dy[0], r.dz[0]) * r.t[0];
+    hit.N = normalize(r.N[0]);
+}
+
+// Nearest hit of the ray O + t D (D unit length) with one patch
+static inline bool rtPick(const RtPatch& rp, const Vec3& O, const Vec3& D, RtHit& hit, float tMax = 1e30f) {
+    RtPacket r;
+    rtSingleRay(r, O, D, tMax);
+    if (!rtTracePacket(rp, r, 1)) return false;
+    rtFillHit(r, hit);
+    hit.patch = 0;
+    return true;
+}
+
+// Many patches, each with its own hierarchy, under a top-level tree of their root
+// boxes split at the median centroid, one patch per leaf
+struct RtModelNode {
+    float lo[3], hi[3];
+    int child = -1;           // first of two consecutive children, -1 for a leaf
+    int patch = -1;
+};
+
+struct RtModel {
+    std::vector<RtPatch> patches;
+    std::vector<RtModelNode> nodes;
+};
+
+static inline void rtBuildModelNode(RtModel& m, int index, int* order, int count) {
+    RtModelNode& node = m.nodes[index];
+    for (int k = 0; k < 3; k++) { node.lo[k] = 1e30f; node.hi[k] = -1e30f; }
+    float clo[3] = { 1e30f, 1e30f, 1e30f }, chi[3] = { -1e30f, -1e30f, -1e30f };
+    for (int i = 0; i < count; i++) {
+        const RtNode& root = m.patches[order[i]].nodes[0];
+        for (int k = 0; k < 3; k++) {
+            node.lo[k] = std::min(node.lo[k], root.lo[k]);
+            node.hi[k] = std::max(node.hi[k], root.hi[k]);
+            float c = root.lo[k] + root.hi[k];
+            clo[k] = std::min(clo[k], c);
+            chi[k] = std::max(chi[k], c);
+        }
+    }
+    if (count == 1) {
+        node.patch = order[0];
+        return;
+    }
+    int axis = 0;
+    for (int k = 1; k < 3; k++)
+        if (chi[k] - clo[k] > chi[axis] - clo[axis]) axis = k;
+    int half = count / 2;
+    std::nth_element(order, order + half, order + count, [&](int a, int b) {
+        const RtNode& ra = m.patches[a].nodes[0];
+        const RtNode& rb = m.patches[b].nodes[0];
+        return ra.lo[axis] + ra.hi[axis] < rb.lo[axis] + rb.hi[axis];
+    });
+    int child = static_cast<int>(m.nodes.size());
+    m.nodes[index].child = child; // node is invalidated by the resize
+    m.nodes.resize(m.nodes.size() + 2);
+    rtBuildModelNode(m, child, order, half);
+    rtBuildModelNode(m, child + 1, order + half, count - half);
+}
+
+// nets: `count` BezierNet-layout arrays of 48 floats ((i*4+j)*3, i along u)
+static inline void rtBuildModel(RtModel& m, const float* nets, size_t count) {
+    m.patches.assign(count, RtPatch());
+    m.nodes.clear();
+    if (count == 0) return;
+    std::vector<int> order(count);
+    for (size_t p = 0; p < count; p++) {
+        Vec3 net[4][4];
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++) {
+                const float* q = nets + p * 48 + (i * 4 + j) * 3;
+                net[i][j] = Vec3(q[0], q[1], q[2]);
+            }
+        rtBuild(m.patches[p], net);
+        order[p] = static_cast<int>(p);
+    }
+    m.nodes.resize(1);
+    rtBuildModelNode(m, 0, order.data(), static_cast<int>(count));
+}
+
+// Nearest hit of the ray O + t D (D unit length) with any patch of the model
+static inline bool rtPickModel(const RtModel& m, const Vec3& O, const Vec3& D, RtHit& hit, float tMax = 1e30f) {
+    if (m.nodes.empty()) return false;
+    RtPacket r;
+    rtSingleRay(r, O, D, tMax);
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    int found = -1;
+    while (top > 0) {
+        const RtModelNode& node = m.nodes[stack[--top]];
+        if (!rtBoxMask(node.lo, node.hi, r, 1)) continue;
+        if (node.child < 0) {
+            if (rtTracePacket(m.patches[node.patch], r, 1)) found = node.patch;
+            continue;
+        }
+        const RtModelNode& a = m.nodes[node.child];
+        const RtModelNode& b = m.nodes[node.child + 1];
+        float ca = 0.0f, cb = 0.0f;
+        const float d[3] = { D.x, D.y, D.z };
+        for (int k = 0; k < 3; k++) {
+            ca += (a.lo[k] + a.hi[k]) * d[k];
+            cb += (b.lo[k] + b.hi[k]) * d[k];
+        }
+        if (ca <= cb) { stack[top++] = node.child + 1; stack[top++] = node.child; }
+        else { stack[top++] = node.child; stack[top++] = node.child + 1; }
+    }
+    if (found < 0) return false;
+    rtFillHit(r, hit);
+    hit.patch = found;
+    return true;
+}
+
+// Window depth of a point at eye distance ze along the view axis (glDepthRange 0..1)
+static inline float rtWindowDepth(const RtCamera& cam, float ze) {
+    float n = cam.zNear, f = cam.zFar;
+    float ndc = (f + n) / (f - n) - 2.0f * f * n / ((f - n) * ze);
+    return std::min(1.0f, std::max(0.0f, 0.5f * ndc + 0.5f));
+}
+
+// One progressive pass at pixel step `step`: traces the pixels on that grid that the
+// previous (2 * step) pass did not and fills each one's step x step block.
+// shade(P, N, &rgb[3]) colours a hit; N is normalized Pu x Pv.
+template <class Shade>
+static inline void rtRenderPass(const RtPatch& rp, RtImage& img, int step, const unsigned char background[3],
+    WorkStealingPool& pool, const Shade& shade) {
+    const RtCamera& cam = img.cam;
+    int tilesX = (img.w + rtTile - 1) / rtTile, tilesY = (img.h + rtTile - 1) / rtTile;
+    bool first = step >= rtFirstStep;
+    pool.parallelFor(static_cast<size_t>(tilesX) * tilesY, [&](size_t tile, unsigned) {
+        int tx = static_cast<int>(tile % tilesX) * rtTile, ty = static_cast<int>(tile / tilesX) * rtTile;
+        int x1 = std::min(img.w, tx + rtTile), y1 = std::min(img.h, ty + rtTile);
+        for (int y = ty; y < y1; y += 2 * step)
+            for (int x = tx; x < x1; x += 2 * step) {
+                RtPacket r;
+                int px[4], py[4];
+                int active = 0;
+                for (int l = 0; l < 4; l++) {
+                    px[l] = x + (l & 1) * step;
+                    py[l] = y + (l >> 1) * step;
+                    float sx = (2.0f * (px[l] + 0.5f) / img.w - 1.0f) * cam.tanHalfFov * cam.aspect;
+                    float sy = (2.0f * (py[l] + 0.5f) / img.h - 1.0f) * cam.tanHalfFov;
+                    Vec3 D = normalize(cam.forward + cam.right * sx + cam.up * sy);
+                    r.ox[l] = cam.pos.x; r.oy[l] = cam.pos.y; r.oz[l] = cam.pos.z;
+                    r.dx[l] = D.x; r.dy[l] = D.y; r.dz[l] = D.z;
+                    r.ix[l] = 1.0f / D.x; r.iy[l] = 1.0f / D.y; r.iz[l] = 1.0f / D.z;
+                    r.t[l] = cam.zFar * 2.0f;
+                    if (px[l] < x1 && py[l] < y1 && (first || l != 0)) active |= 1 << l;
+                }
+                int hit = rtTracePacket(rp, r, active);
+                for (int l = 0; l < 4; l++) {
+                    if (!(active & (1 << l))) continue;
+                    unsigned char c[3] = { background[0], background[1], background[2] };
+                    float z = 1.0f;
+                    if (hit & (1 << l)) {
+                        Vec3 D(r.dx[l], r.dy[l], r.dz[l]);
+                        Vec3 P = cam.pos + D * r.t[l];
+                        shade(P, normalize(r.N[l]), c);
+                        z = rtWindowDepth(cam, r.t[l] * dotp(D, cam.forward));
+                    }
+                    int bx1 = std::min(x1, px[l] + step), by1 = std::min(y1, py[l] + step);
+                    for (int by = py[l]; by < by1; by++)
+                        for (int bx = px[l]; bx < bx1; bx++) {
+                            size_t k = static_cast<size_t>(by) * img.w + bx;
+                            memcpy(&img.rgb[k * 3], c, 3);
+                            img.depth[k] = z;
+                        }
+                }
+            }
+    });
+    img.step = step;
+}
+
+// Starts over when the size or camera changed; otherwise continues the progression
+static inline bool rtRestartIfChanged(RtImage& img, int w, int h, const RtCamera& cam) {
+    if (img.w == w && img.h == h && memcmp(&img.cam, &cam, sizeof(cam)) == 0) return false;
+    img.w = w;
+    img.h = h;
+    img.cam = cam;
+    img.rgb.resize(static_cast<size_t>(w) * h * 3);
+    img.depth.resize(static_cast<size_t>(w) * h);
+    img.step = 0;
+    return true;
+}
+
+// Step of the next pass, 0 once the image is complete
+static inline int rtNextStep(const RtImage& img) {
+    return img.step == 0 ? rtFirstStep : img.step / 2;
+}
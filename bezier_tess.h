@@ -0,0 +1,148 @@
+// Bicubic patches tessellated by the GPU (GL 4.0 tessellation shaders).
+// Each 4x4 net is one 16-vertex GL_PATCHES primitive read from a buffer object.
+// The control shader picks every outer level from the projected length of that
+// boundary's control polygon (pixels / edgePixels), so neighbouring patches agree
+// on shared edges, and the evaluation shader does the Bernstein evaluation.
+// Like bezier_gpu.h the viewer supplies `vec4 shade(vec3 P, vec3 N)` (object
+// space) and a fragment shader reading `color`, `backColor` and `texcoord`.
+#pragma once
+
+#include <string>
+#include "gl_ext.h"
+
+struct TessPatches {
+    GLuint program = 0;
+    GLuint netVbo = 0;
+    GLint viewportLoc = -1, edgePixelsLoc = -1;
+    GLsizei patchCount = 0;
+    bool tried = false;    // init is not retried after a failure
+};
+
+static const char* tessPatchesVS =
+    "#version 400 compatibility\n"
+    "in vec3 position;\n"
+    "out vec3 cp;\n"
+    "void main() {\n"
+    "    cp = position;\n"
+    "}\n";
+
+static const char* tessPatchesTCS =
+    "#version 400 compatibility\n"
+    "layout(vertices = 16) out;\n"
+    "in vec3 cp[];\n"
+    "out vec3 net[];\n"
+    "uniform vec2 viewport;\n"
+    "uniform float edgePixels;\n"
+    "const float maxLevel = 64.0; // GL 4.0 guarantees at least 64\n"
+    "vec2 toPixels(vec3 p, inout bool behind) {\n"
+    "    vec4 c = gl_ModelViewProjectionMatrix * vec4(p, 1.0);\n"
+    "    behind = behind || c.w <= 1e-4;\n"
+    "    return c.xy / max(c.w, 1e-4) * 0.5 * viewport;\n"
+    "}\n"
+    "// control points a, a+s, a+2s, a+3s; the sum is symmetric so both owners of an edge agree\n"
+    "float edgeLevel(int a, int s) {\n"
+    "    bool behind = false;\n"
+    "    vec2 p0 = toPixels(cp[a], behind), p1 = toPixels(cp[a + s], behind);\n"
+    "    vec2 p2 = toPixels(cp[a + 2 * s], behind), p3 = toPixels(cp[a + 3 * s], behind);\n"
+    "    if (behind) return maxLevel;\n"
+    "    float len = distance(p1, p2) + (distance(p0, p1) + distance(p2, p3));\n"
+    "    return clamp(ceil(len / edgePixels), 1.0, maxLevel);\n"
+    "}\n"
+    "void main() {\n"
+    "    net[gl_InvocationID] = cp[gl_InvocationID];\n"
+    "    if (gl_InvocationID != 0) return;\n"
+    "    // quad domain: outer 0..3 are the edges u = 0, v = 0, u = 1, v = 1; cp[i * 4 + j], i along u\n"
+    "    float u0 = edgeLevel(0, 1), v0 = edgeLevel(0, 4), u1 = edgeLevel(12, 1), v1 = edgeLevel(3, 4);\n"
+    "    gl_TessLevelOuter[0] = u0;\n"
+    "    gl_TessLevelOuter[1] = v0;\n"
+    "    gl_TessLevelOuter[2] = u1;\n"
+    "    gl_TessLevelOuter[3] = v1;\n"
+    "    gl_TessLevelInner[0] = max(v0, v1);\n"
+    "    gl_TessLevelInner[1] = max(u0, u1);\n"
+    "}\n";
+
+static const char* tessPatchesTES =
+    "#version 400 compatibility\n"
+    "layout(quads, equal_spacing, ccw) in;\n"
+    "in vec3 net[];\n"
+    "out vec4 color;\n"
+    "out vec4 backColor;\n"
+    "out vec2 texcoord;\n"
+    "vec4 shade(vec3 P, vec3 N);\n"
+    "void bernstein3(float t, out vec4 B, out vec4 D) {\n"
+    "    float s = 1.0 - t;\n"
+    "    B = vec4(s * s * s, 3.0 * t * s * s, 3.0 * t * t * s, t * t * t);\n"
+    "    D = vec4(-3.0 * s * s, 3.0 * s * s - 6.0 * t * s, 6.0 * t * s - 3.0 * t * t, 3.0 * t * t);\n"
+    "}\n"
+    "void main() {\n"
+    "    vec2 uv = gl_TessCoord.xy;\n"
+    "    vec4 Bu, Du, Bv, Dv;\n"
+    "    bernstein3(uv.x, Bu, Du);\n"
+    "    bernstein3(uv.y, Bv, Dv);\n"
+    "    vec3 P = vec3(0.0), Pu = vec3(0.0), Pv = vec3(0.0);\n"
+    "    for (int i = 0; i < 4; i++) {\n"
+    "        vec3 r = net[i * 4] * Bv.x + net[i * 4 + 1] * Bv.y + net[i * 4 + 2] * Bv.z + net[i * 4 + 3] * Bv.w;\n"
+    "        vec3 rv = net[i * 4] * Dv.x + net[i * 4 + 1] * Dv.y + net[i * 4 + 2] * Dv.z + net[i * 4 + 3] * Dv.w;\n"
+    "        P += r * Bu[i];\n"
+    "        Pu += r * Du[i];\n"
+    "        Pv += rv * Bu[i];\n"
+    "    }\n"
+    "    vec3 N = cross(Pu, Pv);\n"
+    "    float L = length(N);\n"
+    "    N = L > 0.0 ? N / L : vec3(0.0, 0.0, 1.0);\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(P, 1.0);\n"
+    "    texcoord = uv;\n"
+    "    color = shade(P, N);\n"
+    "    backColor = shade(P, -N);\n"
+    "}\n";
+
+// Needs GL 4.0; call with a current context. Returns false (after saying why,
+// once) when the path is unavailable.
+static inline bool tessPatchesInit(TessPatches& tp, const char* shadeSource, const char* fsSource) {
+    if (tp.tried) return tp.program != 0;
+    tp.tried = true;
+    const GLExt& gl = glExtInit();
+    if (!gl.tessellation) {
+        fprintf(stderr, "Tessellation shaders need GL 4.0; staying on the CPU tessellator\n");
+        return false;
+    }
+    std::string tes = std::string(tessPatchesTES) + shadeSource;
+    const char* sources[4] = { tessPatchesVS, tessPatchesTCS, tes.c_str(), fsSource };
+    const GLenum kinds[4] = { GL_VERTEX_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER, GL_FRAGMENT_SHADER };
+    static const char* attribs[] = { "position", nullptr };
+    tp.program = glExtBuildStages(kinds, sources, 4, attribs);
+    if (!tp.program) return false;
+    tp.viewportLoc = gl.GetUniformLocation(tp.program, "viewport");
+    tp.edgePixelsLoc = gl.GetUniformLocation(tp.program, "edgePixels");
+    gl.GenBuffers(1, &tp.netVbo);
+    return true;
+}
+
+// `count` nets of 48 floats each (BezierNet layout: (i*4+j)*3, i along u)
+static inline void tessPatchesUpload(TessPatches& tp, const float* nets, size_t count) {
+    const GLExt& gl = glExt;
+    gl.BindBuffer(GL_ARRAY_BUFFER, tp.netVbo);
+    gl.BufferData(GL_ARRAY_BUFFER, count * 48 * sizeof(float), nets, GL_STATIC_DRAW);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+    tp.patchCount = static_cast<GLsizei>(count);
+}
+
+// Makes the program current; set any shading uniforms after this, then call tessPatchesDraw
+static inline void tessPatchesBind(const TessPatches& tp, int width, int height, float edgePixels) {
+    const GLExt& gl = glExt;
+    gl.UseProgram(tp.program);
+    gl.Uniform2f(tp.viewportLoc, static_cast<float>(width), static_cast<float>(height));
+    gl.Uniform1f(tp.edgePixelsLoc, edgePixels);
+}
+
+static inline void tessPatchesDraw(const TessPatches& tp) {
+    const GLExt& gl = glExt;
+    gl.BindBuffer(GL_ARRAY_BUFFER, tp.netVbo);
+    gl.EnableVertexAttribArray(0);
+    gl.VertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    gl.PatchParameteri(GL_PATCH_VERTICES, 16);
+    glDrawArrays(GL_PATCHES, 0, tp.patchCount * 16);
+    gl.DisableVertexAttribArray(0);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl.UseProgram(0);
+}
@@ -0,0 +1,70 @@
+// On-demand frame scheduling for the GLUT viewers.
+// Input handlers mark what changed; a frame is posted only when something is
+// dirty, bursts of events before that frame collapse into it, and an optional
+// target rate spaces frames out with glutTimerFunc instead of spinning.
+#pragma once
+
+#include <GL/glut.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+enum DirtyFlags {
+    DIRTY_CAMERA = 1,
+    DIRTY_MESH = 2,
+    DIRTY_MATERIAL = 4,
+    DIRTY_HUD = 8,
+    DIRTY_ALL = 15
+};
+
+struct FrameScheduler {
+    unsigned dirty = DIRTY_ALL;
+    bool posted = false;
+    double minInterval = 0.0; // seconds between frames, 0 = unpaced
+    std::chrono::steady_clock::time_point lastFrame = std::chrono::steady_clock::now();
+    unsigned long frames = 0;
+    bool offscreen = false; // no window (headless runs): the caller draws frames, requests only mark state
+};
+
+static FrameScheduler sched;
+
+static void schedTimer(int) {
+    glutPostRedisplay();
+}
+
+static inline void schedSetTargetFps(double fps) {
+    sched.minInterval = fps > 0.0 ? 1.0 / fps : 0.0;
+}
+
+// Strips "--fps N" from the command line and applies it
+static inline void schedInitFromArgs(int& argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fps") != 0 || i + 1 >= argc) continue;
+        schedSetTargetFps(atof(argv[i + 1]));
+        for (int k = i; k + 2 <= argc; k++) argv[k] = argv[k + 2];
+        argc -= 2;
+        break;
+    }
+}
+
+// Mark state dirty and make sure exactly one frame is pending
+static inline void schedRequest(unsigned flags) {
+    sched.dirty |= flags;
+    if (sched.posted || sched.offscreen) return;
+    sched.posted = true;
+    double since = std::chrono::duration<double>(std::chrono::steady_clock::now() - sched.lastFrame).count();
+    double wait = sched.minInterval - since;
+    if (wait > 0.001) glutTimerFunc(static_cast<unsigned>(wait * 1000.0), schedTimer, 0);
+    else glutPostRedisplay();
+}
+
+// Call first thing in the display callback; returns (and clears) what changed since the last frame.
+// GLUT may also call display on expose/reshape, in which case this returns 0 and the frame is redrawn as is.
+static inline unsigned schedBeginFrame() {
+    unsigned d = sched.dirty;
+    sched.dirty = 0;
+    sched.posted = false;
+    sched.lastFrame = std::chrono::steady_clock::now();
+    sched.frames++;
+    return d;
+}
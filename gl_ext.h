@@ -0,0 +1,347 @@
+// GL entry points beyond 1.1, fetched at runtime.
+// The Windows build links only opengl32 (GL 1.1) and has no extension loader,
+// so the viewers look up what they need here after the window exists and keep
+// their 1.1 code paths when something is missing.
+#pragma once
+
+#include <GL/glut.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER 0x8D40
+#define GL_RENDERBUFFER 0x8D41
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#define GL_DEPTH_ATTACHMENT 0x8D00
+#define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#endif
+#ifndef GL_COLOR_ATTACHMENT1
+#define GL_COLOR_ATTACHMENT1 0x8CE1
+#endif
+#ifndef GL_DEPTH24_STENCIL8
+#define GL_DEPTH24_STENCIL8 0x88F0
+#endif
+#ifndef GL_STENCIL_ATTACHMENT
+#define GL_STENCIL_ATTACHMENT 0x8D20
+#endif
+#ifndef GL_READ_FRAMEBUFFER
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#define GL_DRAW_FRAMEBUFFER 0x8CA9
+#endif
+#ifndef GL_DEPTH_COMPONENT24
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#define GL_STREAM_READ 0x88E1
+#define GL_READ_ONLY 0x88B8
+#endif
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STATIC_DRAW 0x88E4
+#define GL_DYNAMIC_DRAW 0x88E8
+#endif
+#ifndef GL_VERTEX_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#endif
+#ifndef GL_PATCHES
+#define GL_PATCHES 0x000E
+#define GL_PATCH_VERTICES 0x8E72
+#define GL_TESS_EVALUATION_SHADER 0x8E87
+#define GL_TESS_CONTROL_SHADER 0x8E88
+#endif
+#ifndef GL_SAMPLES_PASSED
+#define GL_SAMPLES_PASSED 0x8914
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef GL_MAX_SAMPLES
+#define GL_MAX_SAMPLES 0x8D57
+#endif
+#ifndef GL_MULTISAMPLE
+#define GL_MULTISAMPLE 0x809D
+#endif
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+
+struct GLExt {
+    bool fbo = false;  // framebuffer objects (GL 3.0 / ARB / EXT)
+    bool blit = false; // framebuffer blits (GL 3.0 / EXT_framebuffer_blit)
+    bool msaa = false; // multisampled renderbuffers (GL 3.0 / EXT_framebuffer_multisample)
+    bool vbo = false;  // vertex and index buffer objects (GL 1.5 / ARB_vertex_buffer_object)
+    bool pbo = false;  // buffer objects with pixel pack targets (GL 2.1)
+    bool sync = false; // fence sync objects (GL 3.2 / ARB_sync)
+    bool query = false; // occlusion queries (GL 1.5 / ARB_occlusion_query)
+    bool timer = false; // GPU timer queries (GL 3.3 / ARB_timer_query)
+    bool glsl = false; // GLSL 1.20 programs (GL 2.1)
+    bool instancing = false; // instanced draws with per-instance attributes (GL 3.3 / ARB_instanced_arrays)
+    bool tessellation = false; // tessellation control/evaluation shaders, GLSL 4.00 (GL 4.0 / ARB_tessellation_shader)
+
+    void (APIENTRY* GenFramebuffers)(GLsizei, GLuint*) = nullptr;
+    void (APIENTRY* DeleteFramebuffers)(GLsizei, const GLuint*) = nullptr;
+    void (APIENTRY* BindFramebuffer)(GLenum, GLuint) = nullptr;
+    GLenum (APIENTRY* CheckFramebufferStatus)(GLenum) = nullptr;
+    void (APIENTRY* FramebufferRenderbuffer)(GLenum, GLenum, GLenum, GLuint) = nullptr;
+    void (APIENTRY* GenRenderbuffers)(GLsizei, GLuint*) = nullptr;
+    void (APIENTRY* DeleteRenderbuffers)(GLsizei, const GLuint*) = nullptr;
+    void (APIENTRY* BindRenderbuffer)(GLenum, GLuint) = nullptr;
+    void (APIENTRY* RenderbufferStorage)(GLenum, GLenum, GLsizei, GLsizei) = nullptr;
+    void (APIENTRY* FramebufferTexture2D)(GLenum, GLenum, GLenum, GLuint, GLint) = nullptr;
+    void (APIENTRY* RenderbufferStorageMultisample)(GLenum, GLsizei, GLenum, GLsizei, GLsizei) = nullptr;
+    void (APIENTRY* BlitFramebuffer)(GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield, GLenum) = nullptr;
+
+    void (APIENTRY* GenBuffers)(GLsizei, GLuint*) = nullptr;
+    void (APIENTRY* DeleteBuffers)(GLsizei, const GLuint*) = nullptr;
+    void (APIENTRY* BindBuffer)(GLenum, GLuint) = nullptr;
+    void (APIENTRY* BufferData)(GLenum, ptrdiff_t, const void*, GLenum) = nullptr;
+    void* (APIENTRY* MapBuffer)(GLenum, GLenum) = nullptr;
+    GLboolean (APIENTRY* UnmapBuffer)(GLenum) = nullptr;
+    void (APIENTRY* BufferSubData)(GLenum, ptrdiff_t, ptrdiff_t, const void*) = nullptr;
+
+    GLuint (APIENTRY* CreateShader)(GLenum) = nullptr;
+    void (APIENTRY* ShaderSource)(GLuint, GLsizei, const char* const*, const GLint*) = nullptr;
+    void (APIENTRY* CompileShader)(GLuint) = nullptr;
+    void (APIENTRY* GetShaderiv)(GLuint, GLenum, GLint*) = nullptr;
+    void (APIENTRY* GetShaderInfoLog)(GLuint, GLsizei, GLsizei*, char*) = nullptr;
+    void (APIENTRY* DeleteShader)(GLuint) = nullptr;
+    GLuint (APIENTRY* CreateProgram)() = nullptr;
+    void (APIENTRY* DeleteProgram)(GLuint) = nullptr;
+    void (APIENTRY* AttachShader)(GLuint, GLuint) = nullptr;
+    void (APIENTRY* BindAttribLocation)(GLuint, GLuint, const char*) = nullptr;
+    void (APIENTRY* LinkProgram)(GLuint) = nullptr;
+    void (APIENTRY* GetProgramiv)(GLuint, GLenum, GLint*) = nullptr;
+    void (APIENTRY* GetProgramInfoLog)(GLuint, GLsizei, GLsizei*, char*) = nullptr;
+    void (APIENTRY* UseProgram)(GLuint) = nullptr;
+    GLint (APIENTRY* GetUniformLocation)(GLuint, const char*) = nullptr;
+    void (APIENTRY* Uniform1i)(GLint, GLint) = nullptr;
+    void (APIENTRY* Uniform1f)(GLint, GLfloat) = nullptr;
+    void (APIENTRY* Uniform2f)(GLint, GLfloat, GLfloat) = nullptr;
+    void (APIENTRY* Uniform3f)(GLint, GLfloat, GLfloat, GLfloat) = nullptr;
+    void (APIENTRY* Uniform3fv)(GLint, GLsizei, const GLfloat*) = nullptr;
+    void (APIENTRY* DrawBuffers)(GLsizei, const GLenum*) = nullptr;
+    void (APIENTRY* Disablei)(GLenum, GLuint) = nullptr; // optional, GL 3.0
+    void (APIENTRY* EnableVertexAttribArray)(GLuint) = nullptr;
+    void (APIENTRY* DisableVertexAttribArray)(GLuint) = nullptr;
+    void (APIENTRY* VertexAttribPointer)(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) = nullptr;
+
+    void (APIENTRY* VertexAttribDivisor)(GLuint, GLuint) = nullptr;
+    void (APIENTRY* DrawElementsInstanced)(GLenum, GLsizei, GLenum, const void*, GLsizei) = nullptr;
+
+    void (APIENTRY* PatchParameteri)(GLenum, GLint) = nullptr;
+
+    void (APIENTRY* GenQueries)(GLsizei, GLuint*) = nullptr;
+    void (APIENTRY* DeleteQueries)(GLsizei, const GLuint*) = nullptr;
+    void (APIENTRY* BeginQuery)(GLenum, GLuint) = nullptr;
+    void (APIENTRY* EndQuery)(GLenum) = nullptr;
+    void (APIENTRY* GetQueryObjectuiv)(GLuint, GLenum, GLuint*) = nullptr;
+    void (APIENTRY* GetQueryObjectui64v)(GLuint, GLenum, unsigned long long*) = nullptr;
+
+    // GLsync is an opaque pointer; kept as void* so no GL 3.2 header is needed
+    void* (APIENTRY* FenceSync)(GLenum, GLbitfield) = nullptr;
+    GLenum (APIENTRY* ClientWaitSync)(void*, GLbitfield, unsigned long long) = nullptr;
+    void (APIENTRY* DeleteSync)(void*) = nullptr;
+};
+
+static GLExt glExt;
+
+static inline void* glExtProc(const char* name) {
+#ifdef _WIN32
+    return reinterpret_cast<void*>(wglGetProcAddress(name));
+#else
+    return reinterpret_cast<void*>(glXGetProcAddressARB(reinterpret_cast<const GLubyte*>(name)));
+#endif
+}
+
+// Looks up `name`, then `name` + suffix (EXT/ARB variants with the same signature)
+template <class Fn>
+static inline bool glExtGet(Fn& fn, const char* name, const char* suffix = nullptr) {
+    void* p = glExtProc(name);
+    if (!p && suffix) {
+        char alt[96];
+        size_t n = 0;
+        for (const char* s = name; *s && n + 1 < sizeof(alt); s++) alt[n++] = *s;
+        for (const char* s = suffix; *s && n + 1 < sizeof(alt); s++) alt[n++] = *s;
+        alt[n] = '\0';
+        p = glExtProc(alt);
+    }
+    fn = reinterpret_cast<Fn>(p);
+    return p != nullptr;
+}
+
+// GLX hands out stubs for any name, so a non-null pointer alone proves nothing;
+// each feature also needs the context version or its extension string
+static inline bool glExtSupported(int major, int minor, const char* ext1, const char* ext2 = nullptr) {
+    int vMajor = 0, vMinor = 0;
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    if (version && sscanf(version, "%d.%d", &vMajor, &vMinor) == 2 &&
+        (vMajor > major || (vMajor == major && vMinor >= minor))) return true;
+    const char* exts = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+    if (!exts) return false;
+    const char* names[2] = { ext1, ext2 };
+    for (int k = 0; k < 2; k++) {
+        if (!names[k]) continue;
+        size_t len = strlen(names[k]);
+        for (const char* p = strstr(exts, names[k]); p; p = strstr(p + len, names[k]))
+            if ((p == exts || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) return true;
+    }
+    return false;
+}
+
+// Call once with a current context; safe to call again
+static inline const GLExt& glExtInit() {
+    static bool done = false;
+    if (done) return glExt;
+    done = true;
+
+    bool ok = true;
+    ok &= glExtGet(glExt.GenFramebuffers, "glGenFramebuffers", "EXT");
+    ok &= glExtGet(glExt.DeleteFramebuffers, "glDeleteFramebuffers", "EXT");
+    ok &= glExtGet(glExt.BindFramebuffer, "glBindFramebuffer", "EXT");
+    ok &= glExtGet(glExt.CheckFramebufferStatus, "glCheckFramebufferStatus", "EXT");
+    ok &= glExtGet(glExt.FramebufferRenderbuffer, "glFramebufferRenderbuffer", "EXT");
+    ok &= glExtGet(glExt.GenRenderbuffers, "glGenRenderbuffers", "EXT");
+    ok &= glExtGet(glExt.DeleteRenderbuffers, "glDeleteRenderbuffers", "EXT");
+    ok &= glExtGet(glExt.BindRenderbuffer, "glBindRenderbuffer", "EXT");
+    ok &= glExtGet(glExt.RenderbufferStorage, "glRenderbufferStorage", "EXT");
+    ok &= glExtGet(glExt.FramebufferTexture2D, "glFramebufferTexture2D", "EXT");
+    glExt.fbo = ok && glExtSupported(3, 0, "GL_ARB_framebuffer_object", "GL_EXT_framebuffer_object");
+    glExt.blit = glExt.fbo && glExtGet(glExt.BlitFramebuffer, "glBlitFramebuffer", "EXT") &&
+        glExtSupported(3, 0, "GL_ARB_framebuffer_object", "GL_EXT_framebuffer_blit");
+    glExt.msaa = glExt.blit && glExtGet(glExt.RenderbufferStorageMultisample, "glRenderbufferStorageMultisample", "EXT") &&
+        glExtSupported(3, 0, "GL_ARB_framebuffer_object", "GL_EXT_framebuffer_multisample");
+
+    ok = true;
+    ok &= glExtGet(glExt.GenBuffers, "glGenBuffers", "ARB");
+    ok &= glExtGet(glExt.DeleteBuffers, "glDeleteBuffers", "ARB");
+    ok &= glExtGet(glExt.BindBuffer, "glBindBuffer", "ARB");
+    ok &= glExtGet(glExt.BufferData, "glBufferData", "ARB");
+    ok &= glExtGet(glExt.MapBuffer, "glMapBuffer", "ARB");
+    ok &= glExtGet(glExt.UnmapBuffer, "glUnmapBuffer", "ARB");
+    ok &= glExtGet(glExt.BufferSubData, "glBufferSubData", "ARB");
+    glExt.vbo = ok && glExtSupported(1, 5, "GL_ARB_vertex_buffer_object");
+    glExt.pbo = glExt.vbo && glExtSupported(2, 1, "GL_ARB_pixel_buffer_object", "GL_EXT_pixel_buffer_object");
+
+    ok = true;
+    ok &= glExtGet(glExt.GenQueries, "glGenQueries", "ARB");
+    ok &= glExtGet(glExt.DeleteQueries, "glDeleteQueries", "ARB");
+    ok &= glExtGet(glExt.BeginQuery, "glBeginQuery", "ARB");
+    ok &= glExtGet(glExt.EndQuery, "glEndQuery", "ARB");
+    ok &= glExtGet(glExt.GetQueryObjectuiv, "glGetQueryObjectuiv", "ARB");
+    glExt.query = ok && glExtSupported(1, 5, "GL_ARB_occlusion_query");
+    glExt.timer = glExt.query && glExtGet(glExt.GetQueryObjectui64v, "glGetQueryObjectui64v") &&
+        glExtSupported(3, 3, "GL_ARB_timer_query");
+
+    ok = true;
+    ok &= glExtGet(glExt.FenceSync, "glFenceSync");
+    ok &= glExtGet(glExt.ClientWaitSync, "glClientWaitSync");
+    ok &= glExtGet(glExt.DeleteSync, "glDeleteSync");
+    glExt.sync = ok && glExtSupported(3, 2, "GL_ARB_sync");
+
+    ok = true;
+    ok &= glExtGet(glExt.CreateShader, "glCreateShader");
+    ok &= glExtGet(glExt.ShaderSource, "glShaderSource");
+    ok &= glExtGet(glExt.CompileShader, "glCompileShader");
+    ok &= glExtGet(glExt.GetShaderiv, "glGetShaderiv");
+    ok &= glExtGet(glExt.GetShaderInfoLog, "glGetShaderInfoLog");
+    ok &= glExtGet(glExt.DeleteShader, "glDeleteShader");
+    ok &= glExtGet(glExt.CreateProgram, "glCreateProgram");
+    ok &= glExtGet(glExt.DeleteProgram, "glDeleteProgram");
+    ok &= glExtGet(glExt.AttachShader, "glAttachShader");
+    ok &= glExtGet(glExt.BindAttribLocation, "glBindAttribLocation");
+    ok &= glExtGet(glExt.LinkProgram, "glLinkProgram");
+    ok &= glExtGet(glExt.GetProgramiv, "glGetProgramiv");
+    ok &= glExtGet(glExt.GetProgramInfoLog, "glGetProgramInfoLog");
+    ok &= glExtGet(glExt.UseProgram, "glUseProgram");
+    ok &= glExtGet(glExt.GetUniformLocation, "glGetUniformLocation");
+    ok &= glExtGet(glExt.Uniform1i, "glUniform1i");
+    ok &= glExtGet(glExt.Uniform1f, "glUniform1f");
+    ok &= glExtGet(glExt.Uniform2f, "glUniform2f");
+    ok &= glExtGet(glExt.Uniform3f, "glUniform3f");
+    ok &= glExtGet(glExt.Uniform3fv, "glUniform3fv");
+    ok &= glExtGet(glExt.DrawBuffers, "glDrawBuffers");
+    ok &= glExtGet(glExt.EnableVertexAttribArray, "glEnableVertexAttribArray");
+    ok &= glExtGet(glExt.DisableVertexAttribArray, "glDisableVertexAttribArray");
+    ok &= glExtGet(glExt.VertexAttribPointer, "glVertexAttribPointer");
+    glExt.glsl = ok && glExtSupported(2, 1, nullptr);
+    if (!glExtSupported(3, 0, nullptr) || !glExtGet(glExt.Disablei, "glDisablei")) glExt.Disablei = nullptr;
+
+    ok = glExt.glsl;
+    ok &= glExtGet(glExt.VertexAttribDivisor, "glVertexAttribDivisor", "ARB");
+    ok &= glExtGet(glExt.DrawElementsInstanced, "glDrawElementsInstanced", "ARB");
+    glExt.instancing = ok && glExtSupported(3, 3, "GL_ARB_instanced_arrays") &&
+        glExtSupported(3, 1, "GL_ARB_draw_instanced");
+
+    // the shaders are #version 400, so the extension alone is not enough
+    glExt.tessellation = glExt.glsl && glExt.vbo && glExtGet(glExt.PatchParameteri, "glPatchParameteri") &&
+        glExtSupported(4, 0, nullptr);
+    return glExt;
+}
+
+// Compile and link a program from `count` stages (kinds[k] = GL_VERTEX_SHADER, ...). `attribs`
+// is a null-terminated list bound to locations 0, 1, 2... before linking. Returns 0 (after
+// printing the log) on failure.
+static inline GLuint glExtBuildStages(const GLenum* kinds, const char* const* sources, int count, const char* const* attribs) {
+    const GLExt& gl = glExt;
+    if (!gl.glsl) return 0;
+    GLuint program = gl.CreateProgram();
+    char log[1024];
+    for (int k = 0; k < count; k++) {
+        GLuint shader = gl.CreateShader(kinds[k]);
+        gl.ShaderSource(shader, 1, &sources[k], nullptr);
+        gl.CompileShader(shader);
+        GLint ok = 0;
+        gl.GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+        if (!ok) {
+            const char* stage = kinds[k] == GL_VERTEX_SHADER ? "vertex" : kinds[k] == GL_FRAGMENT_SHADER ? "fragment" :
+                kinds[k] == GL_TESS_CONTROL_SHADER ? "tessellation control" : "tessellation evaluation";
+            gl.GetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            fprintf(stderr, "%s shader failed to compile:\n%s\n", stage, log);
+            gl.DeleteShader(shader);
+            gl.DeleteProgram(program); // and the stages already attached
+            return 0;
+        }
+        gl.AttachShader(program, shader);
+        gl.DeleteShader(shader); // freed with the program
+    }
+    for (GLuint i = 0; attribs && attribs[i]; i++) gl.BindAttribLocation(program, i, attribs[i]);
+    gl.LinkProgram(program);
+    GLint ok = 0;
+    gl.GetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        gl.GetProgramInfoLog(program, sizeof(log), nullptr, log);
+        fprintf(stderr, "program failed to link:\n%s\n", log);
+        gl.DeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// Vertex/fragment program; see glExtBuildStages
+static inline GLuint glExtBuildProgram(const char* vsSource, const char* fsSource, const char* const* attribs) {
+    const char* sources[2] = { vsSource, fsSource };
+    const GLenum kinds[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    return glExtBuildStages(kinds, sources, 2, attribs);
+}
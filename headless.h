@@ -0,0 +1,333 @@
+// Headless rendering for batch runs and image regression tests.
+// Without a display GLUT cannot open a window, so "--headless script" renders into
+// an EGL pbuffer on Mesa's surfaceless platform instead (llvmpipe when there is no
+// GPU). libEGL is loaded at run time, so windowed builds do not link against it.
+//
+// The script is read line by line; '#' starts a comment.
+//   size W H          resize the offscreen target (default: the program's window size)
+//   shot FILE         render a frame and write it as .ppm or .png
+//   compare REF [TOL] fail unless the last shot matches REF (.ppm) to within TOL per channel
+// Every other line is "key args..." and goes to the program's settings callback.
+// All three viewers read "camera AZ EL DIST" (degrees, degrees, distance to the
+// orbit center), so one script poses them the same way.
+// The run exits non-zero if a line fails or a comparison does not match.
+#pragma once
+
+#include <GL/glut.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+struct Headless {
+    bool active = false;
+    const char* script = nullptr;
+    int w = 0, h = 0;
+    std::vector<unsigned char> image; // last shot, RGB rows top to bottom
+
+    // EGL objects, kept opaque so no EGL headers are needed
+    void* lib = nullptr;
+    void* display = nullptr;
+    void* config = nullptr;
+    void* context = nullptr;
+    void* surface = nullptr;
+};
+
+static Headless headless;
+
+// Window size for code that would otherwise ask GLUT
+static inline int headlessWindowWidth() { return headless.active ? headless.w : glutGet(GLUT_WINDOW_WIDTH); }
+static inline int headlessWindowHeight() { return headless.active ? headless.h : glutGet(GLUT_WINDOW_HEIGHT); }
+
+// Strips "--headless script" from the command line; call before glutInit, which it replaces
+static inline bool headlessFromArgs(int& argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") != 0 || i + 1 >= argc) continue;
+        headless.script = argv[i + 1];
+        headless.active = true;
+        for (int k = i; k + 2 <= argc; k++) argv[k] = argv[k + 2];
+        argc -= 2;
+        break;
+    }
+    return headless.active;
+}
+
+#ifndef _WIN32
+typedef int32_t HeadlessEGLint;
+typedef void* (*HeadlessEGLGetProcAddress)(const char*);
+typedef void* (*HeadlessEGLGetPlatformDisplay)(unsigned, void*, const HeadlessEGLint*);
+typedef void* (*HeadlessEGLGetDisplay)(void*);
+typedef unsigned (*HeadlessEGLInitialize)(void*, HeadlessEGLint*, HeadlessEGLint*);
+typedef unsigned (*HeadlessEGLChooseConfig)(void*, const HeadlessEGLint*, void**, HeadlessEGLint, HeadlessEGLint*);
+typedef unsigned (*HeadlessEGLBindAPI)(unsigned);
+typedef void* (*HeadlessEGLCreateContext)(void*, void*, void*, const HeadlessEGLint*);
+typedef void* (*HeadlessEGLCreatePbufferSurface)(void*, void*, const HeadlessEGLint*);
+typedef unsigned (*HeadlessEGLDestroySurface)(void*, void*);
+typedef unsigned (*HeadlessEGLMakeCurrent)(void*, void*, void*, void*);
+
+enum {
+    HEADLESS_EGL_PLATFORM_SURFACELESS_MESA = 0x31DD,
+    HEADLESS_EGL_SURFACE_TYPE = 0x3033,
+    HEADLESS_EGL_PBUFFER_BIT = 0x0001,
+    HEADLESS_EGL_RED_SIZE = 0x3024,
+    HEADLESS_EGL_GREEN_SIZE = 0x3023,
+    HEADLESS_EGL_BLUE_SIZE = 0x3022,
+    HEADLESS_EGL_DEPTH_SIZE = 0x3025,
+    HEADLESS_EGL_RENDERABLE_TYPE = 0x3040,
+    HEADLESS_EGL_OPENGL_BIT = 0x0008,
+    HEADLESS_EGL_OPENGL_API = 0x30A2,
+    HEADLESS_EGL_WIDTH = 0x3057,
+    HEADLESS_EGL_HEIGHT = 0x3056,
+    HEADLESS_EGL_NONE = 0x3038
+};
+
+template <class Fn>
+static inline Fn headlessEGL(const char* name) {
+    return reinterpret_cast<Fn>(dlsym(headless.lib, name));
+}
+#endif
+
+// (Re)creates the pbuffer at w x h and makes it current with a matching viewport
+static inline bool headlessResize(int w, int h) {
+#ifdef _WIN32
+    (void)w; (void)h;
+    return false;
+#else
+    if (headless.surface) headlessEGL<HeadlessEGLDestroySurface>("eglDestroySurface")(headless.display, headless.surface);
+    HeadlessEGLint attribs[] = { HEADLESS_EGL_WIDTH, w, HEADLESS_EGL_HEIGHT, h, HEADLESS_EGL_NONE };
+    headless.surface = headlessEGL<HeadlessEGLCreatePbufferSurface>("eglCreatePbufferSurface")(headless.display, headless.config, attribs);
+    if (!headless.surface ||
+        !headlessEGL<HeadlessEGLMakeCurrent>("eglMakeCurrent")(headless.display, headless.surface, headless.surface, headless.context)) {
+        fprintf(stderr, "headless: no %dx%d pbuffer\n", w, h);
+        return false;
+    }
+    headless.w = w;
+    headless.h = h;
+    glViewport(0, 0, w, h);
+    return true;
+#endif
+}
+
+// Creates the offscreen context; the GL state afterwards is what glutCreateWindow would give
+static inline bool headlessInit(int w, int h) {
+#ifdef _WIN32
+    (void)w; (void)h;
+    fprintf(stderr, "headless: needs EGL (Linux with Mesa)\n");
+    return false;
+#else
+    headless.lib = dlopen("libEGL.so.1", RTLD_NOW);
+    if (!headless.lib) {
+        fprintf(stderr, "headless: libEGL.so.1 not found\n");
+        return false;
+    }
+    HeadlessEGLGetPlatformDisplay getPlatformDisplay = reinterpret_cast<HeadlessEGLGetPlatformDisplay>(
+        headlessEGL<HeadlessEGLGetProcAddress>("eglGetProcAddress")("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay) headless.display = getPlatformDisplay(HEADLESS_EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr);
+    if (!headless.display) headless.display = headlessEGL<HeadlessEGLGetDisplay>("eglGetDisplay")(nullptr);
+    HeadlessEGLint major = 0, minor = 0;
+    if (!headless.display || !headlessEGL<HeadlessEGLInitialize>("eglInitialize")(headless.display, &major, &minor)) {
+        fprintf(stderr, "headless: no EGL display\n");
+        return false;
+    }
+    HeadlessEGLint attribs[] = {
+        HEADLESS_EGL_SURFACE_TYPE, HEADLESS_EGL_PBUFFER_BIT, HEADLESS_EGL_RED_SIZE, 8, HEADLESS_EGL_GREEN_SIZE, 8,
+        HEADLESS_EGL_BLUE_SIZE, 8, HEADLESS_EGL_DEPTH_SIZE, 24, HEADLESS_EGL_RENDERABLE_TYPE, HEADLESS_EGL_OPENGL_BIT,
+        HEADLESS_EGL_NONE
+    };
+    HeadlessEGLint configs = 0;
+    if (!headlessEGL<HeadlessEGLChooseConfig>("eglChooseConfig")(headless.display, attribs, &headless.config, 1, &configs) ||
+        configs < 1 || !headlessEGL<HeadlessEGLBindAPI>("eglBindAPI")(HEADLESS_EGL_OPENGL_API)) {
+        fprintf(stderr, "headless: no desktop GL pbuffer config\n");
+        return false;
+    }
+    headless.context = headlessEGL<HeadlessEGLCreateContext>("eglCreateContext")(headless.display, headless.config, nullptr, nullptr);
+    if (!headless.context) {
+        fprintf(stderr, "headless: no GL context\n");
+        return false;
+    }
+    if (!headlessResize(w, h)) return false;
+    printf("Headless: EGL %d.%d, %s\n", major, minor, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    return true;
+#endif
+}
+
+static inline void headlessCapture() {
+    int w = headless.w, h = headless.h;
+    std::vector<unsigned char> rows(static_cast<size_t>(w) * h * 3);
+    glFinish();
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_BACK);
+    glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, rows.data());
+    glPopClientAttrib();
+    headless.image.resize(rows.size());
+    for (int y = 0; y < h; y++)
+        memcpy(&headless.image[static_cast<size_t>(y) * w * 3], &rows[static_cast<size_t>(h - 1 - y) * w * 3], static_cast<size_t>(w) * 3);
+}
+
+static inline uint32_t headlessCrc(uint32_t crc, const unsigned char* p, size_t n) {
+    static uint32_t table[256];
+    if (!table[1])
+        for (uint32_t k = 0; k < 256; k++) {
+            uint32_t c = k;
+            for (int b = 0; b < 8; b++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[k] = c;
+        }
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static inline void headlessPngChunk(std::ofstream& out, const char* type, const std::vector<unsigned char>& data) {
+    unsigned char len[4] = { static_cast<unsigned char>(data.size() >> 24), static_cast<unsigned char>(data.size() >> 16),
+        static_cast<unsigned char>(data.size() >> 8), static_cast<unsigned char>(data.size()) };
+    out.write(reinterpret_cast<const char*>(len), 4);
+    std::vector<unsigned char> body(type, type + 4);
+    body.insert(body.end(), data.begin(), data.end());
+    uint32_t crc = headlessCrc(0, body.data(), body.size());
+    unsigned char tail[4] = { static_cast<unsigned char>(crc >> 24), static_cast<unsigned char>(crc >> 16),
+        static_cast<unsigned char>(crc >> 8), static_cast<unsigned char>(crc) };
+    out.write(reinterpret_cast<const char*>(body.data()), body.size());
+    out.write(reinterpret_cast<const char*>(tail), 4);
+}
+
+// PNG with stored (uncompressed) deflate blocks: exact pixels, no zlib dependency
+static inline bool headlessWritePng(const char* fname, int w, int h, const std::vector<unsigned char>& rgb) {
+    std::ofstream out(fname, std::ios::binary);
+    if (!out) return false;
+    static const unsigned char signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+    out.write(reinterpret_cast<const char*>(signature), 8);
+    std::vector<unsigned char> ihdr = { static_cast<unsigned char>(w >> 24), static_cast<unsigned char>(w >> 16),
+        static_cast<unsigned char>(w >> 8), static_cast<unsigned char>(w), static_cast<unsigned char>(h >> 24),
+        static_cast<unsigned char>(h >> 16), static_cast<unsigned char>(h >> 8), static_cast<unsigned char>(h),
+        8, 2, 0, 0, 0 }; // 8-bit RGB
+    headlessPngChunk(out, "IHDR", ihdr);
+
+    std::vector<unsigned char> raw;
+    raw.reserve(static_cast<size_t>(w * 3 + 1) * h);
+    for (int y = 0; y < h; y++) {
+        raw.push_back(0); // filter: none
+        raw.insert(raw.end(), rgb.begin() + static_cast<size_t>(y) * w * 3, rgb.begin() + static_cast<size_t>(y + 1) * w * 3);
+    }
+    std::vector<unsigned char> z = { 0x78, 0x01 };
+    uint32_t a = 1, b = 0;
+    for (size_t pos = 0; pos < raw.size() || pos == 0;) {
+        size_t n = std::min<size_t>(65535, raw.size() - pos);
+        bool last = pos + n == raw.size();
+        z.push_back(last ? 1 : 0);
+        z.push_back(static_cast<unsigned char>(n)); z.push_back(static_cast<unsigned char>(n >> 8));
+        z.push_back(static_cast<unsigned char>(~n)); z.push_back(static_cast<unsigned char>(~n >> 8));
+        z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + n);
+        for (size_t i = pos; i < pos + n; i++) {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        pos += n;
+        if (last) break;
+    }
+    uint32_t adler = (b << 16) | a;
+    for (int s = 24; s >= 0; s -= 8) z.push_back(static_cast<unsigned char>(adler >> s));
+    headlessPngChunk(out, "IDAT", z);
+    headlessPngChunk(out, "IEND", std::vector<unsigned char>());
+    return static_cast<bool>(out);
+}
+
+static inline bool headlessWriteImage(const char* fname) {
+    size_t n = strlen(fname);
+    if (n > 4 && strcmp(fname + n - 4, ".png") == 0)
+        return headlessWritePng(fname, headless.w, headless.h, headless.image);
+    std::ofstream out(fname, std::ios::binary);
+    out << "P6\n" << headless.w << " " << headless.h << "\n255\n";
+    out.write(reinterpret_cast<const char*>(headless.image.data()), headless.image.size());
+    return static_cast<bool>(out);
+}
+
+// Binary PPM (P6, maxval 255) as written by shot
+static inline bool headlessReadPpm(const char* fname, int& w, int& h, std::vector<unsigned char>& rgb) {
+    std::ifstream in(fname, std::ios::binary);
+    std::string magic;
+    int maxval = 0;
+    if (!(in >> magic >> w >> h >> maxval) || magic != "P6" || maxval != 255) return false;
+    in.get();
+    rgb.resize(static_cast<size_t>(w) * h * 3);
+    in.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+    return static_cast<bool>(in);
+}
+
+// Number of pixels where some channel of the last shot differs from REF by more than tol; -1 if REF is unusable
+static inline long headlessCompare(const char* fname, int tol) {
+    int w = 0, h = 0;
+    std::vector<unsigned char> ref;
+    if (!headlessReadPpm(fname, w, h, ref) || w != headless.w || h != headless.h || headless.image.size() != ref.size()) return -1;
+    long bad = 0;
+    for (size_t p = 0; p < ref.size(); p += 3)
+        for (int c = 0; c < 3; c++)
+            if (abs(static_cast<int>(ref[p + c]) - static_cast<int>(headless.image[p + c])) > tol) {
+                bad++;
+                break;
+            }
+    return bad;
+}
+
+// Runs the script. apply(key, args) handles the program's own settings and returns
+// false for keys it does not know; render() draws one frame into the back buffer;
+// resized(w, h), when given, is told about size changes like a GLUT reshape callback.
+static inline int headlessRun(bool (*apply)(const std::string& key, std::istringstream& args), void (*render)(),
+    void (*resized)(int, int) = nullptr) {
+    std::ifstream in(headless.script);
+    if (!in.is_open()) {
+        fprintf(stderr, "headless: cannot read script %s\n", headless.script);
+        return 1;
+    }
+    if (resized) resized(headless.w, headless.h);
+    int failures = 0, lineNo = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        lineNo++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream args(line);
+        std::string key;
+        if (!(args >> key)) continue;
+        bool ok = true;
+        if (key == "size") {
+            int w = 0, h = 0;
+            ok = (args >> w >> h) && w > 0 && h > 0 && headlessResize(w, h);
+            if (ok && resized) resized(w, h);
+        }
+        else if (key == "shot") {
+            std::string fname;
+            ok = static_cast<bool>(args >> fname);
+            if (ok) {
+                render();
+                headlessCapture();
+                ok = headlessWriteImage(fname.c_str());
+                if (ok) printf("%s: %dx%d\n", fname.c_str(), headless.w, headless.h);
+            }
+        }
+        else if (key == "compare") {
+            std::string fname;
+            int tol = 0;
+            ok = static_cast<bool>(args >> fname);
+            if (ok && !(args >> tol)) tol = 0;
+            long bad = ok ? headlessCompare(fname.c_str(), tol) : -1;
+            if (bad < 0) fprintf(stderr, "compare: %s is missing or not a %dx%d P6 image\n", fname.c_str(), headless.w, headless.h);
+            else printf("compare %s (tolerance %d): %ld pixels differ\n", fname.c_str(), tol, bad);
+            ok = ok && bad == 0;
+        }
+        else ok = apply(key, args);
+        if (!ok) {
+            fprintf(stderr, "%s:%d: failed: %s\n", headless.script, lineNo, line.c_str());
+            failures++;
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+// Mesh building on a background thread with a double-buffered result.
+// Input handlers post edits to a bounded single-producer/single-consumer ring
+// (lock-free: one atomic index per side). The worker keeps draining the ring into
+// its own list, so edits that pile up during a build, or while a finished mesh
+// waits for its swap, are folded into the next build instead of each costing one.
+// It fills the back buffer and marks it ready; the render thread swaps it in at
+// the start of a frame and draws the previous mesh until then. The worker does
+// not touch either buffer again before that swap.
+// The mutex only parks the worker: it raises sleeping_ before waiting, and post()
+// and swap() take the lock to notify only when they see it raised, so an edit
+// posted while the worker is busy costs two atomic stores and a fence.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+template <class T, size_t N>
+class SpscRing {
+public:
+    // Producer side; false when full
+    bool push(const T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t next = (head + 1) % N;
+        if (next == tail_.load(std::memory_order_acquire)) return false;
+        items_[head] = item;
+        head_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; false when empty
+    bool pop(T& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) return false;
+        item = items_[tail];
+        tail_.store((tail + 1) % N, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire); }
+
+private:
+    T items_[N];
+    alignas(64) std::atomic<size_t> head_{ 0 }; // next slot to write
+    alignas(64) std::atomic<size_t> tail_{ 0 }; // next slot to read
+};
+
+template <class Edit, class Mesh>
+class MeshWorker {
+public:
+    // build(edits, back, published): apply the drained edits (oldest first) to the
+    // builder's own state and fill back. published is the last mesh handed out and
+    // may be drawn concurrently, so it is only read.
+    typedef std::function<void(const std::vector<Edit>&, Mesh&, const Mesh&)> BuildFn;
+
+    ~MeshWorker() {
+        if (!thread_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    void setBuild(BuildFn build) { build_ = build; }
+
+    // Until this is called, runInline() builds on the caller's thread (headless runs, benchmarks)
+    void startThread() {
+        if (!thread_.joinable()) thread_ = std::thread(&MeshWorker::loop, this);
+    }
+    bool threaded() const { return thread_.joinable(); }
+
+    // Render/input thread. Waits only while the ring is full and the worker is mid-build.
+    void post(const Edit& e) {
+        while (!ring_.push(e)) {
+            if (threaded()) std::this_thread::yield();
+            else drain(); // nobody else empties the ring
+        }
+        wake();
+    }
+
+    // Render thread, at frame start: true when a newer mesh became the front one
+    bool swap() {
+        if (!ready_.load(std::memory_order_acquire)) return false;
+        front_.store(front_.load() ^ 1);
+        ready_.store(false, std::memory_order_release);
+        wake();
+        return true;
+    }
+
+    // Builds and swaps in everything queued; a no-op when the thread is running
+    void runInline() {
+        if (threaded()) return;
+        if (buildPending()) swap();
+    }
+
+    const Mesh& front() const { return buffers_[front_.load()]; }
+    bool ready() const { return ready_.load(std::memory_order_acquire); }
+    // edits queued, a build running, or a finished one not yet swapped in
+    bool busy() const { return !ring_.empty() || holding_.load() || building_.load() || ready(); }
+
+private:
+    void wake() {
+        // Pairs with the fence in loop(): either the worker's wait condition sees what was
+        // just published, or this sees sleeping_. Then taking the lock orders the notify
+        // after the worker's check-then-wait, so no wakeup is lost.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!sleeping_.load(std::memory_order_relaxed)) return;
+        { std::lock_guard<std::mutex> lock(mutex_); }
+        wake_.notify_one();
+    }
+
+    // Each flag is raised before the previous one drops, so busy() never reads false mid-handoff
+    void drain() {
+        if (ring_.empty()) return;
+        holding_.store(true);
+        Edit e;
+        while (ring_.pop(e)) pending_.push_back(e);
+    }
+
+    bool buildPending() {
+        drain();
+        if (pending_.empty()) return false;
+        int back = front_.load() ^ 1;
+        building_.store(true);
+        holding_.store(false);
+        build_(pending_, buffers_[back], buffers_[back ^ 1]);
+        pending_.clear();
+        ready_.store(true, std::memory_order_release);
+        building_.store(false);
+        return true;
+    }
+
+    void loop() {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                sleeping_.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                wake_.wait(lock, [this] { return quit_ || !ring_.empty() || (!ready_.load() && !pending_.empty()); });
+                sleeping_.store(false, std::memory_order_relaxed);
+                if (quit_) return;
+            }
+            if (ready_.load()) drain(); // the back buffer is not ours until the swap
+            else buildPending();
+        }
+    }
+
+    SpscRing<Edit, 1024> ring_;
+    Mesh buffers_[2];
+    std::atomic<int> front_{ 0 };
+    std::atomic<bool> ready_{ false };    // back buffer holds a finished mesh
+    std::atomic<bool> building_{ false };
+    std::atomic<bool> holding_{ false };  // pending_ is not empty
+    std::atomic<bool> sleeping_{ false }; // worker is in (or about to enter) its wait
+    std::vector<Edit> pending_;         // drained, not yet built (worker thread, or the caller when inline)
+    BuildFn build_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool quit_ = false;
+};
@@ -0,0 +1,529 @@
+// Microbenchmarks for the patch evaluation, tessellation and picking hot paths.
+// The three viewers are compiled in here, each in its own namespace with main()
+// renamed, so every timing is of the exact code the viewers run. GL work (the
+// 4_3 draw loop, 4_2 picking) runs in a headless context (see headless.h) and
+// is skipped when none is available.
+//
+//   g++ -std=c++17 -O2 -pthread microbench.cpp -lglut -lGLU -lGL -ldl -o microbench
+//   microbench [--out FILE] [--max-res N] [--quick]
+//
+// Output is one JSON document: per benchmark the best-of-five time per call and
+// per sample, triangles/s where a mesh is produced, and heap allocations counted
+// by the operator new below, for the first (cold) call and for a warm one.
+#include <GL/freeglut.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bezier_core.h"
+#include "bezier_batch.h"
+#include "bezier_model.h"
+#include "bezier_adaptive.h"
+#include "bezier_gpu.h"
+#include "bezier_raytrace.h"
+#include "bezier_tess.h"
+#include "frame_scheduler.h"
+#include "gl_ext.h"
+#include "headless.h"
+#include "mesh_worker.h"
+#ifdef _WIN32
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define fdopen _fdopen
+#else
+#include <unistd.h>
+#endif
+
+static std::atomic<size_t> allocCount{ 0 }, allocBytes{ 0 };
+
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+// Out of line so the compiler does not pair the replaced operators with malloc/free
+// and warn about mismatched allocation functions
+static BENCH_NOINLINE void* countedAlloc(size_t n) {
+    allocCount++;
+    allocBytes += n;
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+static BENCH_NOINLINE void countedFree(void* p) noexcept { free(p); }
+
+void* operator new(size_t n) { return countedAlloc(n); }
+void* operator new[](size_t n) { return countedAlloc(n); }
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+
+// the viewers use the MSVC name; elsewhere it is snprintf
+#ifndef _MSC_VER
+#define sprintf_s snprintf
+#endif
+
+#define main viewerMain
+namespace task1 {
+#include "4_1.cpp"
+}
+namespace task2 {
+#include "4_2.cpp"
+}
+namespace task3 {
+#include "4_3.cpp"
+}
+#undef main
+
+struct BenchResult {
+    std::string name;
+    std::string params;      // extra JSON members, e.g. "\"res\": 100"
+    double nsPerCall = 0.0;
+    double samples = 1.0;    // samples (points, vertices, picks) per call
+    double triangles = 0.0;  // triangles produced per call, 0 if none
+    size_t coldAllocs = 0, coldBytes = 0;
+    size_t warmAllocs = 0, warmBytes = 0;
+    long calls = 0;
+};
+
+static std::vector<BenchResult> benchResults;
+static double batchSeconds = 0.05; // length of each of the five timed batches
+static volatile float benchSink;   // keeps evaluated values alive
+
+// Times fn() after one cold call; allocations are counted on the cold call and on the next one
+template <class Fn>
+static void measure(const std::string& name, const std::string& params, double samples, double triangles, Fn fn) {
+    typedef std::chrono::steady_clock Clock;
+    BenchResult r;
+    r.name = name;
+    r.params = params;
+    r.samples = samples;
+    r.triangles = triangles;
+    size_t a0 = allocCount, b0 = allocBytes;
+    fn();
+    r.coldAllocs = allocCount - a0;
+    r.coldBytes = allocBytes - b0;
+    a0 = allocCount;
+    b0 = allocBytes;
+    Clock::time_point t0 = Clock::now();
+    fn();
+    double once = std::chrono::duration<double>(Clock::now() - t0).count();
+    r.warmAllocs = allocCount - a0;
+    r.warmBytes = allocBytes - b0;
+
+    long calls = std::max(1L, static_cast<long>(batchSeconds / std::max(once, 1e-9)));
+    double best = once;
+    for (int b = 0; b < 5; b++) {
+        t0 = Clock::now();
+        for (long i = 0; i < calls; i++) fn();
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - t0).count() / calls);
+    }
+    r.nsPerCall = best * 1e9;
+    r.calls = 2 + 5 * calls;
+    benchResults.push_back(r);
+    fprintf(stderr, "  %-28s %-34s %12.1f ns/call %10.2f ns/sample\n", name.c_str(), params.c_str(), r.nsPerCall, r.nsPerCall / samples);
+}
+
+static std::string param(const char* key, int value) {
+    return "\"" + std::string(key) + "\": " + std::to_string(value);
+}
+
+static std::string param(const char* key, const char* value) {
+    return "\"" + std::string(key) + "\": \"" + value + "\"";
+}
+
+// ---- patch evaluation ------------------------------------------------------
+
+static const int gridSide = 64; // (u, v) samples per call of the point evaluators
+
+// Sample parameters, filled at run time so no evaluator sees constant or loop-counter inputs
+static float sampleU[gridSide * gridSide], sampleV[gridSide * gridSide];
+
+static float sum3(const Vec3& p) { return p.x + p.y + p.z; }
+
+// Every degree goes through an out-of-line call, as the viewers' cubic wrappers do, so
+// none is inlined into the sample loop with its unused components dropped
+template <int D>
+static BENCH_NOINLINE void coreBernstein(float t, float* B) { bernstein<D>(t, B); }
+template <int D>
+static BENCH_NOINLINE void coreBernsteinDeriv(float t, float* B) { bernsteinDeriv<D>(t, B); }
+template <int D>
+static BENCH_NOINLINE Vec3 coreEval(const Vec3 (&net)[D + 1][D + 1], float u, float v) { return bezierEval(net, u, v); }
+template <int D>
+static BENCH_NOINLINE void coreEvalPower(const Vec3 (&C)[D + 1][D + 1], float u, float v, PatchEval& e) { bezierEvalPower(C, u, v, e); }
+
+// bezier_core.h at degree D in u and v, on a net with a bump in the middle
+template <int D>
+static void benchCoreDegree() {
+    const double n = gridSide * gridSide;
+    std::string p = param("degree", D);
+    measure("core/bernstein", p, n, 0, [] {
+        float B[D + 1], s = 0.0f;
+        for (int k = 0; k < gridSide * gridSide; k++) {
+            coreBernstein<D>(sampleU[k], B);
+            for (int i = 0; i <= D; i++) s += B[i];
+        }
+        benchSink = s;
+    });
+    measure("core/bernsteinDeriv", p, n, 0, [] {
+        float B[D + 1], s = 0.0f;
+        for (int k = 0; k < gridSide * gridSide; k++) {
+            coreBernsteinDeriv<D>(sampleU[k], B);
+            for (int i = 0; i <= D; i++) s += B[i];
+        }
+        benchSink = s;
+    });
+    static Vec3 net[D + 1][D + 1], C[D + 1][D + 1];
+    for (int i = 0; i <= D; i++)
+        for (int j = 0; j <= D; j++)
+            net[i][j] = Vec3(i - 0.5f * D, j - 0.5f * D, (i > 0 && i < D && j > 0 && j < D) ? 1.0f : 0.0f);
+    bezierToPower(net, C);
+    measure("core/bezierEval", p, n, 0, [] {
+        float s = 0.0f;
+        for (int k = 0; k < gridSide * gridSide; k++) s += sum3(coreEval<D>(net, sampleU[k], sampleV[k]));
+        benchSink = s;
+    });
+    measure("core/bezierEvalPower", p, n, 0, [] {
+        PatchEval e;
+        float s = 0.0f;
+        for (int k = 0; k < gridSide * gridSide; k++) {
+            coreEvalPower<D>(C, sampleU[k], sampleV[k], e);
+            s += sum3(e.P) + sum3(e.Pu) + sum3(e.Pv);
+        }
+        benchSink = s;
+    });
+}
+
+static void benchEvaluators() {
+    const double n = gridSide * gridSide;
+    for (int j = 0; j < gridSide; j++)
+        for (int i = 0; i < gridSide; i++) {
+            sampleU[j * gridSide + i] = i / float(gridSide - 1);
+            sampleV[j * gridSide + i] = j / float(gridSide - 1);
+        }
+    benchCoreDegree<2>();
+    benchCoreDegree<3>();
+    benchCoreDegree<5>();
+    measure("4_1/evaluatePatchPt", "", n, 0, [] {
+        float s = 0.0f;
+        for (int k = 0; k < gridSide * gridSide; k++) s += sum3(task1::evaluatePatchPt(task1::ctrl, sampleU[k], sampleV[k]));
+        benchSink = s;
+    });
+    for (int second = 0; second < 2; second++)
+        measure("4_1/evalPatch", param("derivatives", second ? 2 : 1), n, 0, [second] {
+            PatchEval e;
+            float s = 0.0f;
+            for (int k = 0; k < gridSide * gridSide; k++) {
+                task1::evalPatch(sampleU[k], sampleV[k], e, second != 0);
+                s += sum3(e.P) + sum3(e.Pu) + sum3(e.Pv);
+                if (second) s += sum3(e.Puu) + sum3(e.Puv) + sum3(e.Pvv);
+            }
+            benchSink = s;
+        });
+    measure("4_3/evalP", "", n, 0, [] {
+        float s = 0.0f;
+        for (int k = 0; k < gridSide * gridSide; k++) s += sum3(task3::evalP(sampleU[k], sampleV[k]));
+        benchSink = s;
+    });
+    for (int second = 0; second < 2; second++)
+        measure("4_3/evalPatch", param("derivatives", second ? 2 : 1), n, 0, [second] {
+            PatchEval e;
+            float s = 0.0f;
+            for (int k = 0; k < gridSide * gridSide; k++) {
+                task3::evalPatch(sampleU[k], sampleV[k], e, second != 0);
+                s += sum3(e.P) + sum3(e.Pu) + sum3(e.Pv);
+                if (second) s += sum3(e.Puu) + sum3(e.Puv) + sum3(e.Pvv);
+            }
+            benchSink = s;
+        });
+}
+
+// ---- tessellation ------------------------------------------------------------
+
+static const char* evalNames[] = { "direct", "fwd-diff", "batch", "gpu" };
+
+static void benchBuildMesh(int maxRes) {
+    static const int resolutions[] = { 10, 32, 100, 316, 1000, 4096 };
+    task1::GridMesh mesh;
+    for (int m = 0; m < 3; m++)
+        for (int res : resolutions) {
+            if (res > maxRes) continue;
+            task1::EvalMode mode = static_cast<task1::EvalMode>(m);
+            double verts = double(res + 1) * (res + 1);
+            measure("4_1/buildMesh", param("res", res) + ", " + param("eval", evalNames[m]), verts, 2.0 * res * res, [&] {
+                task1::buildMesh(mesh, task1::ctrl, res, mode);
+            });
+        }
+    // the scratch at the largest resolution is not needed again
+    task1::meshBatch = BatchGrid();
+}
+
+// What an edit costs the worker: a control-point move folded into an incremental update
+// of the published grid (copy + rank-1 update), at the resolutions where builds are slow
+static void benchMeshWorker(int maxRes) {
+    static const int resolutions[] = { 316, 1000 };
+    for (int res : resolutions) {
+        if (res > maxRes) continue;
+        task1::GridMesh published, back;
+        memcpy(task1::workCtrl, task1::ctrl, sizeof(task1::ctrl));
+        task1::MeshEdit settings = {};
+        settings.kind = task1::EDIT_SETTINGS;
+        settings.res = res;
+        settings.mode = task1::EVAL_DIRECT;
+        std::vector<task1::MeshEdit> edits(1, settings);
+        task1::applyMeshEdits(edits, published, back);
+        task1::MeshEdit move = {};
+        move.kind = task1::EDIT_MOVE;
+        move.i = 1;
+        move.j = 2;
+        move.delta = Vec3(0.0f, 0.01f, 0.0f);
+        edits.assign(8, move); // a burst of key repeats queued during the previous build
+        double verts = double(res + 1) * (res + 1);
+        measure("4_1/meshWorkerMoves", param("res", res) + ", \"edits\": 8", verts, 2.0 * res * res, [&] {
+            published.incrementalUpdates = 0;
+            task1::applyMeshEdits(edits, back, published);
+        });
+    }
+    task1::gridBasisRes = -1;
+    std::vector<float>().swap(task1::gridB);
+    std::vector<float>().swap(task1::gridDB);
+}
+
+// ---- ray tracing -------------------------------------------------------------
+
+// Every progressive pass of 4_1's ray tracer at the default view, for 1, 2, 4, ... threads
+static void benchRaytrace() {
+    const int w = 450, h = 350;
+    RtPatch patch;
+    rtBuild(patch, task1::ctrl);
+    float az = task1::camAzimuth * static_cast<float>(M_PI) / 180.0f, el = task1::camElevation * static_cast<float>(M_PI) / 180.0f;
+    Vec3 eye = task1::patchCenter + Vec3(cosf(el) * cosf(az), sinf(el), cosf(el) * sinf(az)) * task1::camDist;
+    static const unsigned char background[3] = { 31, 31, 31 };
+    auto shade = [](const Vec3&, const Vec3& N, unsigned char* rgb) {
+        rgb[0] = rgb[1] = rgb[2] = static_cast<unsigned char>(fabsf(N.z) * 255.0f);
+    };
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1;; threads = std::min(cores, threads * 2)) {
+        WorkStealingPool pool(threads);
+        RtImage img;
+        measure("4_1/raytrace", param("threads", static_cast<int>(threads)) + ", " + param("leaves", patch.leaves),
+            double(w) * h, 0.0, [&] {
+                img.w = 0;
+                rtRestartIfChanged(img, w, h, rtLookAt(eye, task1::patchCenter, Vec3(0, 1, 0), 45.0f, float(w) / h, 0.1f, 100.0f));
+                for (int step = rtNextStep(img); step; step = rtNextStep(img)) rtRenderPass(patch, img, step, background, pool, shade);
+                benchSink = img.depth[img.depth.size() / 2];
+            });
+        if (threads == cores) break;
+    }
+}
+
+// Surface picks through the two-level hierarchy on a 10x10 grid of teapots (3200 patches);
+// each call is 256 rays from above aimed at random points of the grid
+static void benchSurfacePick() {
+    BezierModel teapot;
+    teapotModel(teapot);
+    std::vector<float> nets;
+    for (int gx = 0; gx < 10; gx++)
+        for (int gy = 0; gy < 10; gy++)
+            for (const BezierNet& n : teapot.patches)
+                for (int k = 0; k < 48; k++) nets.push_back(n.p[k] + (k % 3 == 0 ? gx * 4.0f : k % 3 == 1 ? gy * 4.0f : 0.0f));
+    size_t patches = nets.size() / 48;
+    RtModel model;
+    auto t0 = std::chrono::steady_clock::now();
+    rtBuildModel(model, nets.data(), patches);
+    fprintf(stderr, "  built hierarchy for %zu patches in %.1f ms\n", patches,
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+    const int rays = 256;
+    std::vector<Vec3> origins(rays), dirs(rays);
+    srand(7);
+    for (int i = 0; i < rays; i++) {
+        Vec3 target(rand() / float(RAND_MAX) * 40.0f - 2.0f, rand() / float(RAND_MAX) * 40.0f - 2.0f, 1.5f);
+        origins[i] = Vec3(18.0f, 18.0f, 30.0f);
+        dirs[i] = normalize(target - origins[i]);
+    }
+    int hits = 0;
+    measure("4_1/pickSurface", param("patches", static_cast<int>(patches)), rays, 0.0, [&] {
+        hits = 0;
+        RtHit hit;
+        for (int i = 0; i < rays; i++) hits += rtPickModel(model, origins[i], dirs[i], hit);
+        benchSink = static_cast<float>(hits);
+    });
+    fprintf(stderr, "  %d of %d rays hit\n", hits, rays);
+}
+
+// drawPatch() as display() runs it: tessellation after an edit, drawing every frame
+static void benchDrawPatch(int maxRes) {
+    static const int resolutions[] = { 12, 50, 128, 512, 1024 };
+    task3::init();
+    for (int m = 0; m < 4; m++)
+        for (int res : resolutions) {
+            if (res > maxRes || (m == task3::EVAL_GPU && !task3::gpuReady())) continue;
+            task3::RES = res;
+            task3::evalMode = static_cast<task3::EvalMode>(m);
+            std::string p = param("res", res) + ", " + param("eval", evalNames[m]);
+            double verts = double(res) * res, tris = 2.0 * (res - 1) * (res - 1);
+            measure("4_3/drawPatch", p + ", \"rebuild\": true", verts, tris, [] {
+                task3::mesh.valid = false;
+                task3::display();
+                glFinish();
+            });
+            measure("4_3/drawPatch", p + ", \"rebuild\": false", verts, tris, [] {
+                task3::display();
+                glFinish();
+            });
+        }
+    task3::mesh = task3::MeshCache();
+    task3::evalMode = task3::EVAL_DIRECT;
+}
+
+// ---- picking -----------------------------------------------------------------
+
+static void benchPicking(int objects) {
+    using namespace task2;
+    initGL();
+    initShapes();
+    initAA();
+    aaMode = AA_OFF;
+    srand(1);
+    buildScene(objects);
+    std::string p = param("objects", objects) + ", " + param("width", winW) + ", " + param("height", winH);
+
+    // pixels on a grid over the window, in GLUT mouse coordinates
+    std::vector<std::pair<int, int> > pixels;
+    for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 8; x++) pixels.push_back(std::make_pair((2 * x + 1) * winW / 16, (2 * y + 1) * winH / 16));
+    size_t next = 0;
+    auto pixel = [&]() -> const std::pair<int, int>& { return pixels[next++ % pixels.size()]; };
+
+    std::streambuf* quiet = cout.rdbuf(nullptr); // the pick paths report every pick
+    measure("4_2/pickRayAt", p, 1, 0, [&] {
+        const std::pair<int, int>& q = pixel();
+        benchSink = static_cast<float>(pickRayAt(q.first, q.second));
+    });
+    measure("4_2/pickColorSyncAt", p, 1, 0, [&] {
+        const std::pair<int, int>& q = pixel();
+        benchSink = static_cast<float>(pickColorSyncAt(q.first, q.second));
+    });
+    if (ensurePickTarget())
+        measure("4_2/pickAsync", p + ", \"until\": \"result\"", 1, 0, [&] {
+            const std::pair<int, int>& q = pixel();
+            issuePickAsync(q.first, q.second, std::chrono::steady_clock::now());
+            while (pollAsyncPicks()) {}
+        });
+    if (useIdBuffer) {
+        // a camera move: the frame that writes the ids, their readback and one lookup
+        measure("4_2/idBuffer", p + ", \"until\": \"frame\"", 1, 0, [&] {
+            camAz += 0.25f;
+            schedRequest(DIRTY_CAMERA);
+            display();
+            int id;
+            const std::pair<int, int>& q = pixel();
+            idBufferAt(q.first, q.second, id, true);
+            benchSink = static_cast<float>(id);
+        });
+        measure("4_2/idBufferAt", p + ", \"until\": \"lookup\"", static_cast<double>(pixels.size()), 0, [&] {
+            int id, s = 0;
+            for (size_t k = 0; k < pixels.size(); k++) {
+                idBufferAt(pixels[k].first, pixels[k].second, id, true);
+                s += id;
+            }
+            benchSink = static_cast<float>(s);
+        });
+    }
+    cout.rdbuf(quiet);
+}
+
+// ---- report ------------------------------------------------------------------
+
+static void writeJson(FILE* out, const char* renderer) {
+    fprintf(out, "{\n  \"benchmark\": \"microbench\",\n");
+    fprintf(out, "  \"batch_kernel\": \"%s\",\n", batchKernelName(batchDetectKernel()));
+    fprintf(out, "  \"renderer\": %s%s%s,\n", renderer ? "\"" : "", renderer ? renderer : "null", renderer ? "\"" : "");
+    fprintf(out, "  \"results\": [\n");
+    for (size_t k = 0; k < benchResults.size(); k++) {
+        const BenchResult& r = benchResults[k];
+        fprintf(out, "    { \"name\": \"%s\", %s%s\"ns_per_call\": %.1f, \"ns_per_sample\": %.3f, ",
+            r.name.c_str(), r.params.c_str(), r.params.empty() ? "" : ", ", r.nsPerCall, r.nsPerCall / r.samples);
+        if (r.triangles > 0) fprintf(out, "\"triangles_per_s\": %.4g, ", r.triangles / (r.nsPerCall * 1e-9));
+        fprintf(out, "\"allocs_cold\": %zu, \"bytes_cold\": %zu, \"allocs_warm\": %zu, \"bytes_warm\": %zu, \"calls\": %ld }%s\n",
+            r.coldAllocs, r.coldBytes, r.warmAllocs, r.warmBytes, r.calls, k + 1 < benchResults.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    const char* outName = nullptr;
+    int maxRes = 4096;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outName = argv[++i];
+        else if (strcmp(argv[i], "--max-res") == 0 && i + 1 < argc) maxRes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--quick") == 0) {
+            batchSeconds = 0.01;
+            maxRes = std::min(maxRes, 1000);
+        }
+        else {
+            fprintf(stderr, "usage: microbench [--out FILE] [--max-res N] [--quick]\n");
+            return 2;
+        }
+    }
+
+    // the viewers' status lines go to stderr so stdout carries only the JSON
+    FILE* out = outName ? fopen(outName, "w") : fdopen(dup(1), "w");
+    if (!out) {
+        fprintf(stderr, "cannot write %s\n", outName ? outName : "stdout");
+        return 1;
+    }
+    fflush(stdout);
+    dup2(2, 1);
+
+    task1::setDefaultControlPoints();
+    task1::computePatchCenter();
+    task1::updatePowerCoeffs();
+    task3::setDefaultControlPoints();
+    task3::updatePowerCoeffs();
+
+    fprintf(stderr, "Evaluation\n");
+    benchEvaluators();
+    fprintf(stderr, "Tessellation\n");
+    benchBuildMesh(maxRes);
+    benchMeshWorker(maxRes);
+    fprintf(stderr, "Ray tracing\n");
+    benchRaytrace();
+    benchSurfacePick();
+
+    const char* renderer = nullptr;
+    headless.active = true; // no GLUT: window size, HUD and swaps go through headless.h
+    sched.offscreen = true;
+    if (headlessInit(task2::winW, task2::winH)) {
+        renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        glExtInit();
+        fprintf(stderr, "drawPatch\n");
+        glPushAttrib(GL_ALL_ATTRIB_BITS);
+        benchDrawPatch(maxRes);
+        glPopAttrib();
+        fprintf(stderr, "Picking\n");
+        benchPicking(task2::sceneSizes[1]);
+    }
+    else fprintf(stderr, "No headless GL context; drawPatch and picking skipped\n");
+
+    fflush(stdout);
+    writeJson(out, renderer);
+    fclose(out);
+    return 0;
+}